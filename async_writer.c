@@ -0,0 +1,279 @@
+//
+//  async_writer.c
+//  ffmpeg_proj
+//
+//  Created by HorsonChan on 2026/10/17.
+//
+
+/* O_DIRECT */
+#ifdef __linux__
+#define _GNU_SOURCE
+#endif
+
+#include "async_writer.h"
+#include "common.h"
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <libavutil/time.h>
+
+static WriterBlock *__block_alloc(AsyncWriter *w) {
+    WriterBlock *b = calloc(1, sizeof(WriterBlock));
+    
+    if (!b)
+        return NULL;
+    if (posix_memalign((void **)&b->data, ASYNC_WRITER_ALIGN, w->block_size)) {
+        free(b);
+        return NULL;
+    }
+    return b;
+}
+
+static void __block_free(WriterBlock *b) {
+    free(b->data);
+    free(b);
+}
+
+/* buffered from here on, O_DIRECT only takes aligned offsets and lengths */
+static void __drop_direct(AsyncWriter *w) {
+#ifdef O_DIRECT
+    if (w->direct)
+        fcntl(w->fd, F_SETFL, fcntl(w->fd, F_GETFL) & ~O_DIRECT);
+#endif
+    w->direct = 0;
+}
+
+/* a short write is not an error, only no progress is */
+static int __write_all(AsyncWriter *w, const uint8_t *data, size_t size) {
+    ssize_t n = 0;
+    
+    while (size > 0) {
+        if ((n = write(w->fd, data, size)) < 0) {
+            if (errno == EINTR)
+                continue;
+            return AVERROR(errno);
+        }
+        if (n == 0)
+            return AVERROR(EIO);
+        data += n;
+        size -= n;
+        /* the tail and every block after it start off the alignment */
+        if (size > 0 && w->direct)
+            __drop_direct(w);
+    }
+    return 0;
+}
+
+/* writes full blocks oldest first and hands them back for refilling */
+static int __writer_thread(void *data) {
+    AsyncWriter *w = (AsyncWriter *)data;
+    WriterBlock *b = NULL;
+    int64_t start = 0;
+    int rc = 0;
+    
+    SDL_LockMutex(w->mutex);
+    while (1) {
+        if (!(b = w->head)) {
+            if (w->finish)
+                break;
+            SDL_CondWait(w->cond, w->mutex);
+            continue;
+        }
+        w->head = b->next;
+        if (!w->head)
+            w->tail = NULL;
+        SDL_UnlockMutex(w->mutex);
+    
+        /* after an error the rest is dropped, the producer must not wait on it */
+        start = av_gettime_relative();
+        rc = w->error ? 0 : __write_all(w, b->data, b->size);
+    
+        SDL_LockMutex(w->mutex);
+        w->write_time += av_gettime_relative() - start;
+        w->nb_writes++;
+        if (rc < 0 && !w->error) {
+            av_log(NULL, AV_LOG_ERROR, "[demo log] async writer: %s\n", av_err2str(rc));
+            w->error = rc;
+        } else if (!w->error) {
+            w->bytes_written += b->size;
+        }
+        b->size = 0;
+        b->next = w->free_blocks;
+        w->free_blocks = b;
+        SDL_CondBroadcast(w->cond);
+    }
+    SDL_UnlockMutex(w->mutex);
+    return 0;
+}
+
+/* a free block, or a new one while under max_blocks, otherwise wait for the writer */
+static int __next_block(AsyncWriter *w) {
+    int64_t stall_start = 0;
+    int rc = 0;
+    
+    SDL_LockMutex(w->mutex);
+    while (!w->free_blocks && w->nb_blocks >= w->max_blocks && !w->error) {
+        if (!stall_start)
+            stall_start = av_gettime_relative();
+        SDL_CondWait(w->cond, w->mutex);
+    }
+    if (stall_start) {
+        w->nb_stalls++;
+        w->stall_time += av_gettime_relative() - stall_start;
+    }
+    
+    if ((rc = w->error) < 0) {
+        goto __exit;
+    } else if (w->free_blocks) {
+        w->cur = w->free_blocks;
+        w->free_blocks = w->cur->next;
+    } else if ((w->cur = __block_alloc(w))) {
+        w->nb_blocks++;
+    } else {
+        rc = AVERROR(ENOMEM);
+    }
+    
+__exit:
+    SDL_UnlockMutex(w->mutex);
+    return rc;
+}
+
+static int __submit(AsyncWriter *w) {
+    int rc = 0;
+    
+    SDL_LockMutex(w->mutex);
+    w->cur->next = NULL;
+    if (w->tail)
+        w->tail->next = w->cur;
+    else
+        w->head = w->cur;
+    w->tail = w->cur;
+    w->cur = NULL;
+    rc = w->error;
+    SDL_CondSignal(w->cond);
+    SDL_UnlockMutex(w->mutex);
+    return rc;
+}
+
+int asyncWriter_open(AsyncWriter *w, const char *filename, size_t block_size, int max_blocks, int direct) {
+    int rc = 0;
+    int flags = O_WRONLY | O_CREAT | O_TRUNC;
+    
+    memset(w, 0, sizeof(AsyncWriter));
+    w->fd = -1;
+    w->block_size = FFALIGN(FFMAX(block_size, ASYNC_WRITER_ALIGN), ASYNC_WRITER_ALIGN);
+    w->max_blocks = FFMAX(max_blocks, 2);
+    
+#ifdef O_DIRECT
+    /* tmpfs and a few others refuse it, buffered is still better than nothing */
+    if (direct && (w->fd = open(filename, flags | O_DIRECT, 0644)) >= 0)
+        w->direct = 1;
+#endif
+    if (w->fd < 0 && (w->fd = open(filename, flags, 0644)) < 0) {
+        rc = AVERROR(errno);
+        av_log(NULL, AV_LOG_ERROR, "[demo log] failed to open %s: %s\n", filename, av_err2str(rc));
+        return rc;
+    }
+#ifdef F_NOCACHE
+    if (direct)
+        fcntl(w->fd, F_NOCACHE, 1);
+#endif
+    
+    w->mutex = SDL_CreateMutex();
+    w->cond = SDL_CreateCond();
+    CHECK_ERROR(!(w->thread = SDL_CreateThread(__writer_thread, "async_writer", w)),
+                "failed to create writer thread",
+                AVERROR_UNKNOWN,
+                __exit)
+    
+    av_log(NULL, AV_LOG_VERBOSE,
+           "[demo log] async writer: %s, %zu KB blocks, %d in flight at most%s\n",
+           filename,
+           w->block_size / 1024,
+           w->max_blocks,
+           w->direct ? ", O_DIRECT" : "");
+    
+__exit:
+    return rc;
+}
+
+int asyncWriter_write(AsyncWriter *w, const uint8_t *data, size_t size) {
+    size_t n = 0;
+    int rc = 0;
+    
+    while (size > 0) {
+        if (!w->cur && (rc = __next_block(w)) < 0)
+            return rc;
+        n = FFMIN(size, w->block_size - w->cur->size);
+        memcpy(w->cur->data + w->cur->size, data, n);
+        w->cur->size += n;
+        data += n;
+        size -= n;
+        if (w->cur->size == w->block_size && (rc = __submit(w)) < 0)
+            return rc;
+    }
+    return 0;
+}
+
+/* also for a half opened writer, once per asyncWriter_open */
+int asyncWriter_close(AsyncWriter *w) {
+    WriterBlock *b = NULL;
+    int rc = 0;
+    
+    if (w->mutex) {
+        SDL_LockMutex(w->mutex);
+        w->finish = 1;
+        SDL_CondSignal(w->cond);
+        SDL_UnlockMutex(w->mutex);
+    }
+    if (w->thread) {
+        SDL_WaitThread(w->thread, NULL);
+        w->thread = NULL;
+    }
+    rc = w->error;
+    
+    /* the partly filled block goes last, O_DIRECT only takes whole blocks so it goes through the page cache */
+    if (w->cur) {
+        if (w->cur->size && !rc) {
+            __drop_direct(w);
+            if (!(rc = __write_all(w, w->cur->data, w->cur->size)))
+                w->bytes_written += w->cur->size;
+        }
+        __block_free(w->cur);
+        w->cur = NULL;
+    }
+    while ((b = w->head)) {
+        w->head = b->next;
+        __block_free(b);
+    }
+    w->tail = NULL;
+    while ((b = w->free_blocks)) {
+        w->free_blocks = b->next;
+        __block_free(b);
+    }
+    w->nb_blocks = 0;
+    
+    if (w->fd >= 0) {
+        if (close(w->fd) < 0 && !rc)
+            rc = AVERROR(errno);
+        w->fd = -1;
+    }
+    av_log(NULL, AV_LOG_INFO,
+           "[demo log] async writer: %lld bytes in %lld writes, %.1f ms writing, encoder waited %lld times for %.1f ms\n",
+           (long long)w->bytes_written,
+           (long long)w->nb_writes,
+           w->write_time / 1000.0,
+           (long long)w->nb_stalls,
+           w->stall_time / 1000.0);
+    
+    if (w->cond) {
+        SDL_DestroyCond(w->cond);
+        w->cond = NULL;
+    }
+    if (w->mutex) {
+        SDL_DestroyMutex(w->mutex);
+        w->mutex = NULL;
+    }
+    return rc;
+}
@@ -0,0 +1,66 @@
+//
+//  async_writer.h
+//  ffmpeg_proj
+//
+//  Created by HorsonChan on 2026/10/17.
+//
+
+#ifndef async_writer_h
+#define async_writer_h
+
+#include <stdio.h>
+#include <stdint.h>
+#include <SDL.h>
+
+/* O_DIRECT wants buffer, length and file offset on this boundary */
+#define ASYNC_WRITER_ALIGN 4096
+#define ASYNC_WRITER_BLOCK_SIZE (1024 * 1024)
+/* blocks filled or being written at most, the producer waits beyond that */
+#define ASYNC_WRITER_MAX_BLOCKS 8
+
+typedef struct WriterBlock {
+    uint8_t *data;
+    size_t size;                /* bytes used */
+    struct WriterBlock *next;
+} WriterBlock;
+
+/*
+ * file sink for encoded output: writes are copied into large aligned blocks,
+ * a full block goes to a background thread that writes it out in order. the
+ * producer only waits once max_blocks are in flight, so a slow disk costs
+ * memory up to that bound and never a syscall per packet.
+ */
+typedef struct AsyncWriter {
+    int fd;
+    int direct;                 /* O_DIRECT in effect, whole blocks only until close or a short write */
+    size_t block_size;          /* multiple of ASYNC_WRITER_ALIGN */
+    int max_blocks;
+    SDL_Thread *thread;
+    
+    SDL_mutex *mutex;
+    SDL_cond *cond;
+    WriterBlock *cur;           /* producer private, being filled */
+    WriterBlock *head, *tail;   /* full, oldest first */
+    WriterBlock *free_blocks;
+    int nb_blocks;              /* allocated */
+    int finish;                 /* no more blocks, write the queue and leave */
+    int error;                  /* first write error, sticky */
+    
+    /* writer thread */
+    int64_t bytes_written;
+    int64_t nb_writes;
+    int64_t write_time;         /* microseconds */
+    /* producer found every block in flight */
+    int64_t nb_stalls;
+    int64_t stall_time;         /* microseconds */
+} AsyncWriter;
+
+/* direct asks for O_DIRECT (F_NOCACHE on darwin), silently buffered where the filesystem refuses it */
+int asyncWriter_open(AsyncWriter *w, const char *filename, size_t block_size, int max_blocks, int direct);
+
+/* copies data, blocks only while max_blocks are in flight; returns the writer's error if it had one */
+int asyncWriter_write(AsyncWriter *w, const uint8_t *data, size_t size);
+
+/* writes out everything in order and closes the file, returns the first error */
+int asyncWriter_close(AsyncWriter *w);
+#endif /* async_writer_h */
@@ -6,14 +6,33 @@
 //
 
 #include <stdio.h>
+#include <time.h>
 #include "common.h"
 
-int encode_frame(AVFrame *frame,
-                 AVPacket *pkt,
-                 AVCodecContext *c,
-                 FILE *f) {
+/* stdio buffers it, the caller's fclose flushes */
+static int __write_file(void *opaque, AVPacket *pkt) {
+    FILE *f = (FILE *)opaque;
+    size_t len = fwrite(pkt->data, 1, pkt->size, f);
+    
+    if (len != pkt->size) {
+        av_log(NULL, AV_LOG_WARNING,
+               "Warnning: write data size is not equal to input size\n");
+    }
+    av_log(NULL, AV_LOG_DEBUG, "pkt size: %d, write size: %ld\n", pkt->size, len);
+    return 0;
+}
+
+static int __write_async(void *opaque, AVPacket *pkt) {
+    return asyncWriter_write((AsyncWriter *)opaque, pkt->data, pkt->size);
+}
+
+/* send frame (NULL drains) and hand every packet it yields to write_packet */
+static int __encode(AVFrame *frame,
+                    AVPacket *pkt,
+                    AVCodecContext *c,
+                    int (*write_packet)(void *opaque, AVPacket *pkt),
+                    void *opaque) {
     int rc = 0;
-    size_t len = 0;
     rc = avcodec_send_frame(c, frame);
     
     while (rc == 0) {
@@ -34,18 +53,26 @@ int encode_frame(AVFrame *frame,
             return rc;
         }
         
-        len = fwrite(pkt->data, 1, pkt->size, f);
-        if (len != pkt->size) {
-            av_log(NULL, AV_LOG_WARNING,
-                   "Warnning: write data size is not equal to input size\n");
-        }
-        av_log(NULL, AV_LOG_INFO, "pkt size: %d, write size: %ld\n", pkt->size, len);
-        fflush(f);
+        rc = write_packet(opaque, pkt);
         av_packet_unref(pkt);
     }
     return rc;
 }
 
+int encode_frame(AVFrame *frame,
+                 AVPacket *pkt,
+                 AVCodecContext *c,
+                 FILE *f) {
+    return __encode(frame, pkt, c, __write_file, f);
+}
+
+int encode_frame_async(AVFrame *frame,
+                       AVPacket *pkt,
+                       AVCodecContext *c,
+                       AsyncWriter *w) {
+    return __encode(frame, pkt, c, __write_async, w);
+}
+
 void log_packet(AVFormatContext *fmt_ctx,
                 const AVPacket *pkt,
                 const char *tag) {
@@ -81,3 +108,21 @@ int recive_frame(AVFrame *frame,
     }
     return rc;
 }
+
+double thread_cpu_time(void) {
+#ifdef CLOCK_THREAD_CPUTIME_ID
+    struct timespec ts;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) == 0)
+        return ts.tv_sec + ts.tv_nsec / 1e9;
+#endif
+    return 0.0;
+}
+
+double process_cpu_time(void) {
+#ifdef CLOCK_PROCESS_CPUTIME_ID
+    struct timespec ts;
+    if (clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts) == 0)
+        return ts.tv_sec + ts.tv_nsec / 1e9;
+#endif
+    return (double)clock() / CLOCKS_PER_SEC;
+}
@@ -11,6 +11,7 @@
 #include <libavutil/opt.h>
 #include <libavutil/timestamp.h>
 #include <libavformat/avformat.h>
+#include "async_writer.h"
 
 #define CHECK_ERROR(cond, inf, code, tip) \
 if (cond) { \
@@ -33,9 +34,19 @@ int encode_frame(AVFrame *frame,
                  AVCodecContext *c,
                  FILE *f);
 
+/* same, packets go to a writer thread in large blocks, see async_writer.h */
+int encode_frame_async(AVFrame *frame,
+                       AVPacket *pkt,
+                       AVCodecContext *c,
+                       AsyncWriter *w);
+
 void log_packet(AVFormatContext *fmt_ctx,
                 const AVPacket *pkt,
                 const char *tag);
 
 int recive_frame(AVFrame *frame,
                  AVCodecContext *c);
+
+/* cpu seconds consumed by the calling thread / whole process */
+double thread_cpu_time(void);
+double process_cpu_time(void);
@@ -0,0 +1,289 @@
+//
+//  executor.c
+//  ffmpeg_proj
+//
+//  Created by HorsonChan on 2026/10/17.
+//
+
+#include "executor.h"
+#include "common.h"
+
+/* worker the calling thread is, NULL outside the pool */
+static _Thread_local ExecWorker *__current = NULL;
+
+static void __push_tail(ExecWorker *w, ExecTask *task) {
+    SDL_LockMutex(w->mutex);
+    task->next = NULL;
+    task->prev = w->tail;
+    if (w->tail)
+        w->tail->next = task;
+    else
+        w->head = task;
+    w->tail = task;
+    SDL_UnlockMutex(w->mutex);
+}
+
+static void __push_head(ExecWorker *w, ExecTask *task) {
+    SDL_LockMutex(w->mutex);
+    task->prev = NULL;
+    task->next = w->head;
+    if (w->head)
+        w->head->prev = task;
+    else
+        w->tail = task;
+    w->head = task;
+    SDL_UnlockMutex(w->mutex);
+}
+
+static ExecTask *__pop_tail(ExecWorker *w) {
+    ExecTask *task = NULL;
+    
+    SDL_LockMutex(w->mutex);
+    if ((task = w->tail)) {
+        w->tail = task->prev;
+        if (w->tail)
+            w->tail->next = NULL;
+        else
+            w->head = NULL;
+    }
+    SDL_UnlockMutex(w->mutex);
+    return task;
+}
+
+static ExecTask *__pop_head(ExecWorker *w) {
+    ExecTask *task = NULL;
+    
+    SDL_LockMutex(w->mutex);
+    if ((task = w->head)) {
+        w->head = task->next;
+        if (w->head)
+            w->head->prev = NULL;
+        else
+            w->tail = NULL;
+    }
+    SDL_UnlockMutex(w->mutex);
+    return task;
+}
+
+/*
+ * nb_queued goes up before nb_sleeping is read, a worker bumps nb_sleeping
+ * before it reads nb_queued: one of the two always sees the other
+ */
+static void __signal(Executor *e) {
+    atomic_fetch_add(&e->nb_queued, 1);
+    if (atomic_load(&e->nb_sleeping) > 0) {
+        SDL_LockMutex(e->mutex);
+        SDL_CondSignal(e->cond);
+        SDL_UnlockMutex(e->mutex);
+    }
+}
+
+/* woken from a worker: stay there, the data the waker just produced is in its cache */
+static void __schedule(Executor *e, ExecTask *task) {
+    ExecWorker *w = __current && __current->executor == e ? __current :
+                    &e->workers[atomic_fetch_add(&e->next_worker, 1) % e->nb_threads];
+    
+    __push_tail(w, task);
+    __signal(e);
+}
+
+static ExecTask *__next_task(Executor *e, ExecWorker *w) {
+    ExecTask *task = __pop_tail(w);
+    
+    /* own deque empty, take the oldest task of somebody else */
+    for (int i = 1; !task && i < e->nb_threads; i++) {
+        if ((task = __pop_head(&e->workers[(w->idx + i) % e->nb_threads])))
+            w->nb_steals++;
+    }
+    if (task)
+        atomic_fetch_sub(&e->nb_queued, 1);
+    return task;
+}
+
+static void __run(Executor *e, ExecWorker *w, ExecTask *task) {
+    int status = 0;
+    int state = TASK_RUNNING;
+    double cpu_start = thread_cpu_time();
+    
+    atomic_store(&task->state, TASK_RUNNING);
+    status = task->fn(task->opaque);
+    task->cpu_time += thread_cpu_time() - cpu_start;
+    task->nb_runs++;
+    w->nb_runs++;
+    
+    switch (status) {
+        case TASK_AGAIN:
+            /* behind everything else queued here, one busy stream must not starve the rest */
+            atomic_store(&task->state, TASK_QUEUED);
+            __push_head(w, task);
+            __signal(e);
+            break;
+    
+        case TASK_WAIT:
+            /* a wake that came in while running means the condition may have changed already */
+            if (!atomic_compare_exchange_strong(&task->state, &state, TASK_IDLE)) {
+                atomic_store(&task->state, TASK_QUEUED);
+                __push_tail(w, task);
+                __signal(e);
+            }
+            break;
+    
+        default:
+            SDL_LockMutex(e->mutex);
+            atomic_store(&task->state, TASK_FINISHED);
+            SDL_CondBroadcast(e->done_cond);
+            SDL_UnlockMutex(e->mutex);
+            break;
+    }
+}
+
+static int __worker_thread(void *data) {
+    ExecWorker *w = (ExecWorker *)data;
+    Executor *e = w->executor;
+    ExecTask *task = NULL;
+    
+    __current = w;
+    while (1) {
+        if ((task = __next_task(e, w))) {
+            __run(e, w, task);
+            continue;
+        }
+    
+        SDL_LockMutex(e->mutex);
+        atomic_fetch_add(&e->nb_sleeping, 1);
+        while (!atomic_load(&e->nb_queued) && !e->abort_request)
+            SDL_CondWait(e->cond, e->mutex);
+        atomic_fetch_sub(&e->nb_sleeping, 1);
+        if (e->abort_request) {
+            SDL_UnlockMutex(e->mutex);
+            break;
+        }
+        SDL_UnlockMutex(e->mutex);
+    }
+    return 0;
+}
+
+int executor_init(Executor *e, int nb_threads) {
+    memset(e, 0, sizeof(Executor));
+    
+    if (nb_threads <= 0)
+        nb_threads = SDL_GetCPUCount();
+    e->nb_threads = nb_threads < 1 ? 1 :
+                    nb_threads > EXECUTOR_MAX_THREADS ? EXECUTOR_MAX_THREADS : nb_threads;
+    atomic_init(&e->next_worker, 0);
+    atomic_init(&e->nb_queued, 0);
+    atomic_init(&e->nb_sleeping, 0);
+    e->mutex = SDL_CreateMutex();
+    e->cond = SDL_CreateCond();
+    e->done_cond = SDL_CreateCond();
+    
+    /* every deque exists before the first worker may try to steal from it */
+    for (int i = 0; i < e->nb_threads; i++) {
+        e->workers[i].executor = e;
+        e->workers[i].idx = i;
+        e->workers[i].mutex = SDL_CreateMutex();
+    }
+    for (int i = 0; i < e->nb_threads; i++) {
+        if (!(e->workers[i].thread = SDL_CreateThread(__worker_thread,
+                                                      "exec_worker",
+                                                      &e->workers[i]))) {
+            av_log(NULL, AV_LOG_ERROR, "[demo log] failed to create executor thread\n");
+            return AVERROR_UNKNOWN;
+        }
+    }
+    av_log(NULL, AV_LOG_VERBOSE, "[demo log] executor: %d worker threads\n", e->nb_threads);
+    return 0;
+}
+
+ExecTask *executor_task_create(Executor *e, ExecTaskFunc fn, void *opaque, const char *name) {
+    ExecTask *task = calloc(1, sizeof(ExecTask));
+    
+    if (!task)
+        return NULL;
+    task->executor = e;
+    task->fn = fn;
+    task->opaque = opaque;
+    task->name = name;
+    atomic_init(&task->state, TASK_IDLE);
+    return task;
+}
+
+void executor_wake(ExecTask *task) {
+    int state = atomic_load(&task->state);
+    
+    while (1) {
+        if (state == TASK_IDLE) {
+            if (atomic_compare_exchange_weak(&task->state, &state, TASK_QUEUED)) {
+                __schedule(task->executor, task);
+                return;
+            }
+        } else if (state == TASK_RUNNING) {
+            if (atomic_compare_exchange_weak(&task->state, &state, TASK_RUNNING_WOKEN))
+                return;
+        } else {
+            /* queued, woken or finished: nothing to add */
+            return;
+        }
+    }
+}
+
+void executor_task_wait(ExecTask *task) {
+    Executor *e = task->executor;
+    
+    SDL_LockMutex(e->mutex);
+    while (atomic_load(&task->state) != TASK_FINISHED)
+        SDL_CondWait(e->done_cond, e->mutex);
+    SDL_UnlockMutex(e->mutex);
+}
+
+void executor_task_free(ExecTask **task) {
+    if (!*task)
+        return;
+    av_log(NULL, AV_LOG_VERBOSE,
+           "[demo log] executor: %s task ran %lld steps, %.3f s cpu\n",
+           (*task)->name,
+           (long long)(*task)->nb_runs,
+           (*task)->cpu_time);
+    free(*task);
+    *task = NULL;
+}
+
+/* every task has to be finished, see executor_task_wait */
+void executor_destory(Executor *e) {
+    if (e->mutex) {
+        SDL_LockMutex(e->mutex);
+        e->abort_request = 1;
+        SDL_CondBroadcast(e->cond);
+        SDL_UnlockMutex(e->mutex);
+    }
+    
+    for (int i = 0; i < e->nb_threads; i++) {
+        ExecWorker *w = &e->workers[i];
+        if (w->thread) {
+            SDL_WaitThread(w->thread, NULL);
+            w->thread = NULL;
+        }
+        if (w->nb_runs) {
+            av_log(NULL, AV_LOG_INFO,
+                   "[demo log] executor: worker %d ran %lld steps, %lld tasks stolen\n",
+                   i, (long long)w->nb_runs, (long long)w->nb_steals);
+        }
+        if (w->mutex) {
+            SDL_DestroyMutex(w->mutex);
+            w->mutex = NULL;
+        }
+    }
+    
+    if (e->mutex) {
+        SDL_DestroyMutex(e->mutex);
+        e->mutex = NULL;
+    }
+    if (e->cond) {
+        SDL_DestroyCond(e->cond);
+        e->cond = NULL;
+    }
+    if (e->done_cond) {
+        SDL_DestroyCond(e->done_cond);
+        e->done_cond = NULL;
+    }
+}
@@ -0,0 +1,99 @@
+//
+//  executor.h
+//  ffmpeg_proj
+//
+//  Created by HorsonChan on 2026/10/17.
+//
+
+#ifndef executor_h
+#define executor_h
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <SDL.h>
+
+#define EXECUTOR_MAX_THREADS 64
+
+/* what a step asks for next */
+enum {
+    TASK_AGAIN = 0,     /* more work ready, requeue behind the others */
+    TASK_WAIT,          /* input empty or output full, run again once woken */
+    TASK_DONE,          /* never run again */
+};
+
+/* task state, see executor_wake */
+enum {
+    TASK_IDLE = 0,
+    TASK_QUEUED,
+    TASK_RUNNING,
+    TASK_RUNNING_WOKEN, /* woken while running, requeued even if it returns TASK_WAIT */
+    TASK_FINISHED,
+};
+
+/* one bounded step of work that never blocks on a queue, returns TASK_* */
+typedef int (*ExecTaskFunc)(void *opaque);
+
+struct Executor;
+
+typedef struct ExecTask {
+    struct Executor *executor;
+    ExecTaskFunc fn;
+    void *opaque;
+    const char *name;
+    atomic_int state;
+    struct ExecTask *prev, *next;   /* deque links while queued, a task is queued at most once */
+    
+    /* touched by the worker running it only */
+    int64_t nb_runs;
+    double cpu_time;                /* seconds */
+} ExecTask;
+
+typedef struct ExecWorker {
+    struct Executor *executor;
+    int idx;
+    SDL_Thread *thread;
+    
+    /* owner pushes and pops at the tail, thieves take from the head */
+    SDL_mutex *mutex;
+    ExecTask *head, *tail;
+    
+    int64_t nb_runs;
+    int64_t nb_steals;
+} ExecWorker;
+
+/*
+ * fixed pool of workers shared by every player. demux and decode are tasks
+ * that run a step while their input has data and their output has room,
+ * and go idle otherwise until the queue on the other side wakes them.
+ * a woken task lands on the waking worker's deque, idle workers steal.
+ */
+typedef struct Executor {
+    int nb_threads;
+    ExecWorker workers[EXECUTOR_MAX_THREADS];
+    atomic_uint next_worker;        /* wakes from outside the pool go round robin */
+    
+    atomic_int nb_queued;
+    atomic_int nb_sleeping;
+    int abort_request;
+    SDL_mutex *mutex;
+    SDL_cond *cond;                 /* work queued */
+    SDL_cond *done_cond;            /* a task finished */
+} Executor;
+
+/* nb_threads <= 0 takes one worker per core */
+int executor_init(Executor *e, int nb_threads);
+
+/* idle until the first executor_wake */
+ExecTask *executor_task_create(Executor *e, ExecTaskFunc fn, void *opaque, const char *name);
+
+/* callable from any thread, cheap if the task is queued or running already */
+void executor_wake(ExecTask *task);
+
+/* whatever the task waits on must have been told to stop and the task woken */
+void executor_task_wait(ExecTask *task);
+void executor_task_free(ExecTask **task);
+
+void executor_destory(Executor *e);
+
+#endif /* executor_h */
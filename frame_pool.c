@@ -0,0 +1,169 @@
+//
+//  frame_pool.c
+//  ffmpeg_proj
+//
+//  Created by HorsonChan on 2026/10/17.
+//
+
+#include "frame_pool.h"
+#include "common.h"
+#include <stdlib.h>
+#include <limits.h>
+#include <sys/mman.h>
+#include <libavutil/imgutils.h>
+
+/* opaque is the mapped length for huge page buffers, 0 for heap ones */
+static void __free(void *opaque, uint8_t *data) {
+    size_t mapped = (size_t)(uintptr_t)opaque;
+    
+    if (mapped) {
+        munmap(data, mapped);
+    } else {
+        free(data);
+    }
+}
+
+#ifdef MADV_HUGEPAGE
+/* map one huge page more than needed, then cut the start back to a huge page boundary */
+static uint8_t *__map_hugepages(size_t size, size_t *mapped) {
+    size_t len = FFALIGN(size, FRAME_POOL_HUGEPAGE_SIZE);
+    uint8_t *raw = mmap(NULL, len + FRAME_POOL_HUGEPAGE_SIZE,
+                        PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    uint8_t *data = NULL;
+    
+    if (raw == MAP_FAILED)
+        return NULL;
+    data = (uint8_t *)FFALIGN((uintptr_t)raw, FRAME_POOL_HUGEPAGE_SIZE);
+    if (data > raw)
+        munmap(raw, data - raw);
+    munmap(data + len, FRAME_POOL_HUGEPAGE_SIZE - (data - raw));
+    /* only a hint, the kernel may still hand out small pages */
+    madvise(data, len, MADV_HUGEPAGE);
+    *mapped = len;
+    return data;
+}
+#endif
+
+/* called by av_buffer_pool_get with fp->mutex held */
+static AVBufferRef *__alloc(void *opaque, int size) {
+    FramePool *fp = (FramePool *)opaque;
+    AVBufferRef *buf = NULL;
+    uint8_t *data = NULL;
+    size_t mapped = 0;
+    
+#ifdef MADV_HUGEPAGE
+    if (fp->hugepages)
+        data = __map_hugepages(size, &mapped);
+#endif
+    if (!data && posix_memalign((void **)&data, FRAME_POOL_ALIGN, size))
+        return NULL;
+    
+    if (!(buf = av_buffer_create(data, size, __free, (void *)(uintptr_t)mapped, 0))) {
+        __free((void *)(uintptr_t)mapped, data);
+        return NULL;
+    }
+    fp->nb_allocs++;
+    return buf;
+}
+
+/* rows padded to FRAME_POOL_ALIGN, each plane starting on it */
+static int __layout(FramePool *fp, int width, int height, enum AVPixelFormat format) {
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(format);
+    int linesize[4] = { 0 };
+    size_t size = 0;
+    int rc = 0;
+    
+    /* a palette is not a plane of rows, nothing here needs one */
+    if (!desc || (desc->flags & AV_PIX_FMT_FLAG_PAL))
+        return AVERROR(ENOSYS);
+    if ((rc = av_image_fill_linesizes(linesize, format, FFALIGN(width, FRAME_POOL_ALIGN))) < 0)
+        return rc;
+    
+    for (int i = 0; i < 4; i++) {
+        int h = (i == 1 || i == 2) ? AV_CEIL_RSHIFT(height, desc->log2_chroma_h) : height;
+        fp->linesize[i] = FFALIGN(linesize[i], FRAME_POOL_ALIGN);
+        fp->offset[i] = size;
+        size += FFALIGN((size_t)fp->linesize[i] * h, FRAME_POOL_ALIGN);
+    }
+    /* simd may read a little past the last row */
+    fp->size = size + FRAME_POOL_ALIGN;
+    return 0;
+}
+
+int framePool_init(FramePool *fp, int hugepages) {
+    memset(fp, 0, sizeof(FramePool));
+    fp->format = AV_PIX_FMT_NONE;
+    fp->hugepages = hugepages;
+    if (!(fp->mutex = SDL_CreateMutex()))
+        return AVERROR(ENOMEM);
+    return 0;
+}
+
+int framePool_get(FramePool *fp, AVFrame *frame, int width, int height, enum AVPixelFormat format) {
+    int rc = 0;
+    
+    SDL_LockMutex(fp->mutex);
+    if (!fp->pool || width != fp->width || height != fp->height || format != fp->format) {
+        av_buffer_pool_uninit(&fp->pool);
+        CHECK_ERROR(((rc = __layout(fp, width, height, format)) < 0),
+                    "unsupported picture format for the frame pool",
+                    0, __exit)
+        CHECK_ERROR(fp->size > INT_MAX,
+                    "picture too large for the frame pool",
+                    AVERROR(EINVAL),
+                    __exit)
+        CHECK_ERROR(!(fp->pool = av_buffer_pool_init2((int)fp->size, fp, __alloc, NULL)),
+                    "failed to create frame pool",
+                    AVERROR(ENOMEM),
+                    __exit)
+        fp->width = width;
+        fp->height = height;
+        fp->format = format;
+        fp->nb_rebuilds++;
+        av_log(NULL, AV_LOG_VERBOSE,
+               "[demo log] frame pool: %dx%d %s, %zu bytes per picture%s\n",
+               width, height, av_get_pix_fmt_name(format), fp->size,
+               fp->hugepages ? ", huge pages" : "");
+    }
+    
+    CHECK_ERROR(!(frame->buf[0] = av_buffer_pool_get(fp->pool)),
+                "failed to get a picture buffer",
+                AVERROR(ENOMEM),
+                __exit)
+    for (int i = 0; i < 4; i++) {
+        frame->data[i] = fp->linesize[i] ? frame->buf[0]->data + fp->offset[i] : NULL;
+        frame->linesize[i] = fp->linesize[i];
+    }
+    frame->extended_data = frame->data;
+    frame->width = width;
+    frame->height = height;
+    frame->format = format;
+    
+__exit:
+    SDL_UnlockMutex(fp->mutex);
+    return rc;
+}
+
+/* a fresh pool of the same geometry, the old one frees what it holds right away */
+void framePool_trim(FramePool *fp) {
+    SDL_LockMutex(fp->mutex);
+    if (fp->pool) {
+        av_buffer_pool_uninit(&fp->pool);
+        fp->pool = av_buffer_pool_init2((int)fp->size, fp, __alloc, NULL);
+    }
+    SDL_UnlockMutex(fp->mutex);
+}
+
+void framePool_destory(FramePool *fp) {
+    if (fp->nb_allocs) {
+        av_log(NULL, AV_LOG_INFO,
+               "[demo log] frame pool: %lld picture buffers allocated, %lld geometry changes\n",
+               (long long)fp->nb_allocs,
+               (long long)FFMAX(fp->nb_rebuilds - 1, 0));
+    }
+    av_buffer_pool_uninit(&fp->pool);
+    if (fp->mutex) {
+        SDL_DestroyMutex(fp->mutex);
+        fp->mutex = NULL;
+    }
+}
@@ -0,0 +1,53 @@
+//
+//  frame_pool.h
+//  ffmpeg_proj
+//
+//  Created by HorsonChan on 2026/10/17.
+//
+
+#ifndef frame_pool_h
+#define frame_pool_h
+
+#include <stdio.h>
+#include <stdint.h>
+#include <SDL.h>
+#include <libavutil/frame.h>
+#include <libavutil/buffer.h>
+#include <libavutil/pixdesc.h>
+
+/* plane start and row pitch, wide enough for any simd sws or the upload kernels use */
+#define FRAME_POOL_ALIGN 64
+/* transparent huge page size on x86_64 and arm64 */
+#define FRAME_POOL_HUGEPAGE_SIZE (2 * 1024 * 1024)
+
+/*
+ * picture buffers of one geometry and format, recycled through an
+ * AVBufferPool: once every slot of the picture queue had a buffer, a frame
+ * costs no allocation. all planes live in one buffer, each at an aligned
+ * offset. asked for another geometry the pool is rebuilt on the spot,
+ * buffers still out go back to the old pool and are freed with it
+ */
+typedef struct FramePool {
+    SDL_mutex *mutex;
+    AVBufferPool *pool;
+    int width, height;
+    enum AVPixelFormat format;
+    int linesize[4];
+    size_t offset[4];
+    size_t size;
+    int hugepages;              /* back buffers with transparent huge pages where the os has them */
+    
+    int64_t nb_allocs;          /* buffers the pool had to allocate */
+    int64_t nb_rebuilds;        /* geometry or format changes */
+} FramePool;
+
+int framePool_init(FramePool *fp, int hugepages);
+
+/* frame gets a pooled buffer and its geometry, the pool follows width / height / format */
+int framePool_get(FramePool *fp, AVFrame *frame, int width, int height, enum AVPixelFormat format);
+
+/* free the buffers sitting unused in the pool, those still out are not touched */
+void framePool_trim(FramePool *fp);
+
+void framePool_destory(FramePool *fp);
+#endif /* frame_pool_h */
@@ -0,0 +1,112 @@
+//
+//  keyframe_index.c
+//  ffmpeg_proj
+//
+//  Created by HorsonChan on 2026/10/17.
+//
+
+#include "keyframe_index.h"
+
+/* first entry with pts > the given one */
+static int __upper_bound(KeyframeIndex *idx, int64_t pts) {
+    int lo = 0, hi = idx->nb_entries;
+    
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (idx->entries[mid].pts <= pts)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+void keyframeIndex_init(KeyframeIndex *idx) {
+    memset(idx, 0, sizeof(KeyframeIndex));
+    idx->last_pts = AV_NOPTS_VALUE;
+}
+
+/* containers with a full index (mp4 moov, mkv cues) give us every keyframe up front */
+int keyframeIndex_load(KeyframeIndex *idx, AVStream *st) {
+    int rc = 0;
+    
+    for (int i = 0; i < st->nb_index_entries; i++) {
+        AVIndexEntry *e = &st->index_entries[i];
+        if (!(e->flags & AVINDEX_KEYFRAME))
+            continue;
+        if ((rc = keyframeIndex_add(idx, e->timestamp, e->pos)) < 0)
+            return rc;
+    }
+    idx->complete = idx->nb_entries > 0;
+    keyframeIndex_break(idx);
+    
+    av_log(NULL, AV_LOG_VERBOSE,
+           "[demo log] keyframe index: %d entries from container\n",
+           idx->nb_entries);
+    return rc;
+}
+
+/* called for every keyframe in demux order, entries seen back to back get linked */
+int keyframeIndex_add(KeyframeIndex *idx, int64_t pts, int64_t pos) {
+    int at = 0;
+    int64_t last_pts = idx->last_pts;
+    
+    idx->last_pts = pts;
+    /* demuxing forward appends, only a seek back revisits known entries */
+    if (idx->nb_entries && idx->entries[idx->nb_entries - 1].pts < pts) {
+        at = idx->nb_entries;
+    } else {
+        at = __upper_bound(idx, pts);
+        if (at > 0 && idx->entries[at - 1].pts == pts) {
+            at--;
+            goto __link;
+        }
+    }
+    
+    if (idx->nb_entries >= idx->nb_allocated) {
+        int nb_allocated = idx->nb_allocated ? idx->nb_allocated * 2 : 256;
+        KeyframeEntry *entries = av_realloc_array(idx->entries, nb_allocated, sizeof(KeyframeEntry));
+        if (!entries) {
+            av_log(NULL, AV_LOG_ERROR, "failed to grow keyframe index\n");
+            return AVERROR(ENOMEM);
+        }
+        idx->entries = entries;
+        idx->nb_allocated = nb_allocated;
+    }
+    memmove(&idx->entries[at + 1],
+            &idx->entries[at],
+            (idx->nb_entries - at) * sizeof(KeyframeEntry));
+    idx->entries[at].pts = pts;
+    idx->entries[at].pos = pos;
+    idx->entries[at].linked = 0;
+    idx->nb_entries++;
+    
+__link:
+    if (at > 0 && last_pts != AV_NOPTS_VALUE && idx->entries[at - 1].pts == last_pts)
+        idx->entries[at - 1].linked = 1;
+    return 0;
+}
+
+/* a seek ends the current run, the next keyframe is not adjacent to the last one */
+void keyframeIndex_break(KeyframeIndex *idx) {
+    idx->last_pts = AV_NOPTS_VALUE;
+}
+
+/*
+ * closest keyframe at or before pts. a lazily built index may have holes
+ * where we seeked over, an entry only counts if its successor is known
+ */
+const KeyframeEntry *keyframeIndex_lookup(KeyframeIndex *idx, int64_t pts) {
+    int at = __upper_bound(idx, pts);
+    
+    if (at == 0)
+        return NULL;
+    if (!idx->complete && (at == idx->nb_entries || !idx->entries[at - 1].linked))
+        return NULL;
+    return &idx->entries[at - 1];
+}
+
+void keyframeIndex_destory(KeyframeIndex *idx) {
+    av_freep(&idx->entries);
+    idx->nb_entries = idx->nb_allocated = 0;
+}
@@ -0,0 +1,39 @@
+//
+//  keyframe_index.h
+//  ffmpeg_proj
+//
+//  Created by HorsonChan on 2026/10/17.
+//
+
+#ifndef keyframe_index_h
+#define keyframe_index_h
+
+#include <stdio.h>
+#include <stdint.h>
+#include <libavformat/avformat.h>
+
+typedef struct KeyframeEntry {
+    int64_t pts;        /* stream time base */
+    int64_t pos;        /* byte offset of the packet, -1 if unknown */
+    int linked;         /* the next entry follows with no keyframe in between */
+} KeyframeEntry;
+
+/*
+ * video keyframes sorted by pts, seeded from the container index on open
+ * and filled in while demuxing. only touched by the demux thread.
+ */
+typedef struct KeyframeIndex {
+    KeyframeEntry *entries;
+    int nb_entries;
+    int nb_allocated;
+    int complete;       /* came from the container, no keyframe is missing */
+    int64_t last_pts;   /* previous keyframe of the current demux run */
+} KeyframeIndex;
+
+void keyframeIndex_init(KeyframeIndex *idx);
+int keyframeIndex_load(KeyframeIndex *idx, AVStream *st);
+int keyframeIndex_add(KeyframeIndex *idx, int64_t pts, int64_t pos);
+void keyframeIndex_break(KeyframeIndex *idx);
+const KeyframeEntry *keyframeIndex_lookup(KeyframeIndex *idx, int64_t pts);
+void keyframeIndex_destory(KeyframeIndex *idx);
+#endif /* keyframe_index_h */
@@ -7,96 +7,362 @@
 
 #include "packet_queue.h"
 #include "video_info.h"
+#include <libavutil/time.h>
 
-void packetQueue_init(PacketQueue *queue) {
+static int __reach_watermark(PacketQueue *q, double level) {
+    size_t nb_packets = atomic_load(&q->tail) - atomic_load(&q->head);
+    
+    if (nb_packets >= q->capacity)
+        return 1;
+    if (q->max_packets > 0 && nb_packets >= q->max_packets * level)
+        return 1;
+    if (q->max_size > 0 && atomic_load(&q->size) >= q->max_size * level)
+        return 1;
+    if (q->max_duration > 0 && q->time_base.num && q->time_base.den &&
+        atomic_load(&q->duration) * av_q2d(q->time_base) >= q->max_duration * level)
+        return 1;
+    return 0;
+}
+
+/* the peer runs low while q is full: better overfill q than let the peer's decoder run dry */
+static int __peer_starving(PacketQueue *q) {
+    PacketQueue *peer = q->peer;
+    
+    return peer &&
+           !atomic_load(&peer->idle) &&
+           !atomic_load(&peer->abort_request) &&
+           atomic_load(&peer->tail) - atomic_load(&peer->head) < PACKET_QUEUE_MIN_PACKETS &&
+           !__reach_watermark(peer, PACKET_QUEUE_LOW_WATERMARK);
+}
+
+/* producer has to wait at this level of q */
+static int __must_wait(PacketQueue *q, double level) {
+    return __reach_watermark(q, PACKET_QUEUE_HARD_LIMIT) ||
+           (__reach_watermark(q, level) && !__peer_starving(q));
+}
+
+/* the other side only takes the lock when it saw the waiting flag, see seq_cst below */
+static void __wake(PacketQueue *q, SDL_cond *cond, ExecTask *task) {
+    if (task) {
+        executor_wake(task);
+        return;
+    }
+    SDL_LockMutex(q->mutex);
+    SDL_CondSignal(cond);
+    SDL_UnlockMutex(q->mutex);
+}
+
+/* flush and abort concern both sides, whatever they are waiting for */
+static void __wake_tasks(PacketQueue *q) {
+    if (q->producer_task)
+        executor_wake(q->producer_task);
+    if (q->consumer_task)
+        executor_wake(q->consumer_task);
+}
+
+void packetQueue_init(PacketQueue *queue, int max_size, int max_packets, double max_duration) {
+    size_t capacity = 1;
+    
     memset(queue, 0, sizeof(PacketQueue));
+    queue->max_size = max_size;
+    queue->max_packets = max_packets;
+    queue->max_duration = max_duration;
+    
+    /* room to overfill for a starving peer */
+    while (capacity < (max_packets > 0 ? max_packets * PACKET_QUEUE_HARD_LIMIT : PACKET_QUEUE_DEFAULT_CAPACITY))
+        capacity <<= 1;
+    queue->capacity = capacity;
+    queue->ring = av_mallocz_array(capacity, sizeof(AVPacket *));
+    queue->enqueue_time = av_mallocz_array(capacity, sizeof(int64_t));
+    queue->serials = av_mallocz_array(capacity, sizeof(int));
+    
+    atomic_init(&queue->head, 0);
+    atomic_init(&queue->tail, 0);
+    atomic_init(&queue->size, 0);
+    atomic_init(&queue->duration, 0);
+    atomic_init(&queue->producer_waiting, 0);
+    atomic_init(&queue->consumer_waiting, 0);
+    atomic_init(&queue->abort_request, 0);
+    atomic_init(&queue->eof_serial, -1);
+    atomic_init(&queue->serial, 0);
+    atomic_init(&queue->idle, 0);
+    
     queue->mutex = SDL_CreateMutex();
     queue->cond = SDL_CreateCond();
+    queue->full_cond = SDL_CreateCond();
 }
 
-int packetQueue_enqueue(PacketQueue *q, AVPacket *pkt) {
+/* producer side once there is room, or the packet turned out stale */
+static int __push(PacketQueue *q, AVPacket *pkt, int serial) {
     int rc = 0;
-    AVPacketList *node = malloc(sizeof(AVPacketList));
-    if (!node) {
-        rc = AVERROR_UNKNOWN;
-        av_log(NULL, AV_LOG_ERROR, "failed to allocate AVPacket memory\n");
+    size_t tail = 0;
+    AVPacket **slot = NULL;
+    
+    if (atomic_load(&q->abort_request)) {
+        rc = AVERROR_EXIT;
         goto __exit;
     }
-    node->next = NULL;
-
-    rc = av_packet_ref(&node->pkt, pkt);
-    if (rc != 0) {
-        av_log(NULL,
-               AV_LOG_ERROR,
-               "failed to copy avpacket ref for pkt enqueue\n");
+    /* flushed while we were reading or waiting, the packet is stale already */
+    if (serial != atomic_load(&q->serial)) {
+        av_packet_unref(pkt);
         goto __exit;
     }
 
-    SDL_LockMutex(q->mutex);
-
-    if (!q->last_pkt) {
-        q->first_pkt = node;
-    } else {
-        q->last_pkt->next = node;
+    tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+    slot = &q->ring[tail & (q->capacity - 1)];
+    if (!*slot) {
+        if (!(*slot = av_packet_alloc())) {
+            rc = AVERROR(ENOMEM);
+            av_log(NULL, AV_LOG_ERROR, "failed to allocate AVPacket memory\n");
+            goto __exit;
+        }
+        atomic_fetch_add(&q->nb_node_allocs, 1);
     }
+    
+    /* demuxers hand out refcounted packets, only copy the odd one that is not */
+    if (!pkt->buf) {
+        rc = av_packet_make_refcounted(pkt);
+        if (rc < 0) {
+            av_log(NULL,
+                   AV_LOG_ERROR,
+                   "failed to copy avpacket ref for pkt enqueue\n");
+            goto __exit;
+        }
+        atomic_fetch_add(&q->nb_pkt_copies, 1);
+    }
+    
+    /* take over the caller's reference, pkt is left blank */
+    av_packet_move_ref(*slot, pkt);
+    q->enqueue_time[tail & (q->capacity - 1)] = av_gettime_relative();
+    q->serials[tail & (q->capacity - 1)] = serial;
+    atomic_fetch_add(&q->size, (*slot)->size);
+    atomic_fetch_add(&q->duration, (*slot)->duration);
+    /* publish the slot, seq_cst so that the waiting flag is read after it */
+    atomic_store(&q->tail, tail + 1);
 
-    q->last_pkt = node;
-    q->nb_packets++;
-    q->size += node->pkt.size;
-    SDL_CondSignal(q->cond);
-
-//    printf("[demo log] enqueue pkt size: %d, pkt pts: %lld\n", node->pkt.size, node->pkt.pts);
+//    printf("[demo log] enqueue pkt size: %d, pkt pts: %lld\n", (*slot)->size, (*slot)->pts);
 
-    SDL_UnlockMutex(q->mutex);
+    if (atomic_load(&q->consumer_waiting))
+        __wake(q, q->cond, q->consumer_task);
 
 __exit:
     return rc;
 }
 
-int packetQueue_dequeue(PacketQueue *q, AVPacket *pkt, int block, void *userdata) {
+/*
+ * serial is the one the caller saw before reading pkt, so a packet read
+ * across a flush is stamped stale and never reaches the decoder
+ */
+int packetQueue_enqueue(PacketQueue *q, AVPacket *pkt, int serial) {
+    /* backpressure: sleep until the consumer drained down to the low watermark or the peer runs low */
+    if (__must_wait(q, 1.0)) {
+        SDL_LockMutex(q->mutex);
+        atomic_store(&q->producer_waiting, 1);
+        while (__must_wait(q, PACKET_QUEUE_LOW_WATERMARK) &&
+               !atomic_load(&q->abort_request) &&
+               serial == atomic_load(&q->serial))
+            SDL_CondWait(q->full_cond, q->mutex);
+        atomic_store(&q->producer_waiting, 0);
+        SDL_UnlockMutex(q->mutex);
+    }
+    return __push(q, pkt, serial);
+}
+
+/* same backpressure as above, the flag stays up until the queue drained to the low watermark */
+int packetQueue_try_enqueue(PacketQueue *q, AVPacket *pkt, int serial) {
+    if (atomic_load(&q->producer_waiting) || __must_wait(q, 1.0)) {
+        atomic_store(&q->producer_waiting, 1);
+        /* re-check after the flag, the consumer may have drained before it could see it */
+        if (__must_wait(q, PACKET_QUEUE_LOW_WATERMARK) &&
+            !atomic_load(&q->abort_request) &&
+            serial == atomic_load(&q->serial))
+            return AVERROR(EAGAIN);
+        atomic_store(&q->producer_waiting, 0);
+    }
+    return __push(q, pkt, serial);
+}
+
+int packetQueue_dequeue(PacketQueue *q, AVPacket *pkt, int block, void *userdata, int *serial) {
     int rc = 0;
-    AVPacketList *node = NULL;
-    SDL_LockMutex(q->mutex);
+    int eof_serial = 0;
+    int stale = 0;
+    int slot_serial = 0;
+    size_t head = 0;
+    AVPacket *node = NULL;
     
     VideoInfo *info = (VideoInfo *)userdata;
 
     while (1) {
         
-        if (info->quit) {
+        if (info->quit || atomic_load(&q->abort_request)) {
             break;
         }
         
-        node = q->first_pkt;
-        if (node) {
-            q->first_pkt = node->next;
-            if (!q->first_pkt) {
-                q->last_pkt = NULL;
+        /* read eof before the tail, the last packet is published before eof is set */
+        eof_serial = atomic_load(&q->eof_serial);
+        head = atomic_load_explicit(&q->head, memory_order_relaxed);
+        if (head != atomic_load_explicit(&q->tail, memory_order_acquire)) {
+            /* hand the reference to the caller, the blank node stays in its slot */
+            node = q->ring[head & (q->capacity - 1)];
+            slot_serial = q->serials[head & (q->capacity - 1)];
+            stale = slot_serial != atomic_load(&q->serial);
+            if (q->latency && !stale) {
+                latencyHistogram_record(q->latency,
+                                        av_gettime_relative() - q->enqueue_time[head & (q->capacity - 1)]);
             }
-            q->nb_packets--;
-            q->size -= node->pkt.size;
-
-            rc = av_packet_ref(pkt, &node->pkt);
-            if (rc != 0) {
-                av_log(NULL,
-                       AV_LOG_ERROR,
-                       "failed to copy avpacket ref for pkt dequeue\n");
+            atomic_fetch_sub(&q->size, node->size);
+            atomic_fetch_sub(&q->duration, node->duration);
+            if (stale) {
+                av_packet_unref(node);
+            } else {
+                av_packet_move_ref(pkt, node);
             }
+            atomic_store(&q->head, head + 1);
+            
+            if (atomic_load(&q->producer_waiting) &&
+                !__reach_watermark(q, PACKET_QUEUE_LOW_WATERMARK))
+                __wake(q, q->full_cond, q->producer_task);
+            /* the producer may sit on a full peer while we run dry */
+            if (q->peer && atomic_load(&q->peer->producer_waiting) && __peer_starving(q->peer))
+                __wake(q->peer, q->peer->full_cond, q->peer->producer_task);
+            
+            /* flushed away, keep going */
+            if (stale)
+                continue;
+            atomic_store(&q->consumer_waiting, 0);
+            if (serial)
+                *serial = slot_serial;
 
 //            printf("[demo log] dequeue pkt size: %d, pkt pts: %lld\n", pkt->size, pkt->pts);
-            av_packet_unref(&node->pkt);
-            av_free(node);
+            break;
+        } else if (eof_serial == atomic_load(&q->serial)) {
+            if (serial)
+                *serial = eof_serial;
+            rc = AVERROR_EOF;
             break;
         } else if (block) {
-            SDL_CondWait(q->cond, q->mutex);
-        } else if (!block) {
+            /* slow path: flag first, then re-check emptiness under the lock */
+            SDL_LockMutex(q->mutex);
+            atomic_store(&q->consumer_waiting, 1);
+            while (atomic_load(&q->head) == atomic_load(&q->tail) &&
+                   !atomic_load(&q->abort_request) &&
+                   atomic_load(&q->eof_serial) != atomic_load(&q->serial) &&
+                   !info->quit)
+                SDL_CondWait(q->cond, q->mutex);
+            atomic_store(&q->consumer_waiting, 0);
+            SDL_UnlockMutex(q->mutex);
+        } else if (atomic_load(&q->consumer_waiting)) {
+            /* flag was up before we looked, the producer wakes us for anything newer */
+            rc = AVERROR(EAGAIN);
             break;
+        } else {
+            /* raise the flag, then look once more for a packet published before it */
+            atomic_store(&q->consumer_waiting, 1);
         }
     }
     
-    SDL_UnlockMutex(q->mutex);
     return rc;
 }
 
+/* after draining to eof, sleep until a flush moves the queue past serial */
+int packetQueue_wait_serial(PacketQueue *q, int serial, void *userdata) {
+    VideoInfo *info = (VideoInfo *)userdata;
+    
+    SDL_LockMutex(q->mutex);
+    atomic_store(&q->consumer_waiting, 1);
+    while (atomic_load(&q->serial) == serial &&
+           !atomic_load(&q->abort_request) &&
+           !info->quit)
+        SDL_CondWait(q->cond, q->mutex);
+    atomic_store(&q->consumer_waiting, 0);
+    SDL_UnlockMutex(q->mutex);
+    
+    return atomic_load(&q->abort_request) || info->quit ? AVERROR_EXIT : 0;
+}
+
+int packetQueue_serial(PacketQueue *q) {
+    return atomic_load(&q->serial);
+}
+
+int packetQueue_nb_packets(PacketQueue *q) {
+    return (int)(atomic_load(&q->tail) - atomic_load(&q->head));
+}
+
+void packetQueue_log_stats(PacketQueue *q, const char *tag) {
+    av_log(NULL, AV_LOG_VERBOSE,
+           "[demo log] %s queue: %d slot packets allocated, %d packets copied\n",
+           tag,
+           atomic_load(&q->nb_node_allocs),
+           atomic_load(&q->nb_pkt_copies));
+}
+
+void packetQueue_finish(PacketQueue *q, int serial) {
+    SDL_LockMutex(q->mutex);
+    /* a read that failed before a seek does not end the new serial */
+    if (atomic_load(&q->serial) == serial)
+        atomic_store(&q->eof_serial, serial);
+    SDL_CondBroadcast(q->cond);
+    SDL_UnlockMutex(q->mutex);
+    if (q->consumer_task)
+        executor_wake(q->consumer_task);
+}
+
+void packetQueue_set_peer(PacketQueue *a, PacketQueue *b) {
+    a->peer = b;
+    b->peer = a;
+}
+
+/* producer side, e.g. audio while trick play drops it */
+void packetQueue_set_idle(PacketQueue *q, int idle) {
+    atomic_store(&q->idle, idle);
+}
+
+/*
+ * callable from any thread: everything queued so far becomes stale and so
+ * does eof, a blocked producer or consumer wakes up to notice
+ */
+void packetQueue_flush(PacketQueue *q, int serial) {
+    SDL_LockMutex(q->mutex);
+    atomic_store(&q->serial, serial);
+    SDL_CondBroadcast(q->cond);
+    SDL_CondBroadcast(q->full_cond);
+    SDL_UnlockMutex(q->mutex);
+    __wake_tasks(q);
+}
+
+void packetQueue_abort(PacketQueue *q) {
+    SDL_LockMutex(q->mutex);
+    atomic_store(&q->abort_request, 1);
+    SDL_CondBroadcast(q->cond);
+    SDL_CondBroadcast(q->full_cond);
+    SDL_UnlockMutex(q->mutex);
+    __wake_tasks(q);
+}
+
 int packetQueue_destory(PacketQueue *q) {
+    if (q->ring) {
+        for (size_t i = 0; i < q->capacity; i++) {
+            av_packet_free(&q->ring[i]);
+        }
+    }
+    atomic_store(&q->head, atomic_load(&q->tail));
+    atomic_store(&q->size, 0);
+    atomic_store(&q->duration, 0);
+    av_freep(&q->ring);
+    av_freep(&q->enqueue_time);
+    av_freep(&q->serials);
+    
+    if (q->mutex) {
+        SDL_DestroyMutex(q->mutex);
+        q->mutex = NULL;
+    }
+    if (q->cond) {
+        SDL_DestroyCond(q->cond);
+        q->cond = NULL;
+    }
+    if (q->full_cond) {
+        SDL_DestroyCond(q->full_cond);
+        q->full_cond = NULL;
+    }
     return 0;
 }
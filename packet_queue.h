@@ -9,19 +9,93 @@
 #define packet_queue_h
 
 #include <stdio.h>
+#include <stdatomic.h>
 #include <SDL.h>
 #include <libavformat/avformat.h>
+#include "pipeline_stats.h"
+#include "executor.h"
 
+/* once a queue is full, the producer sleeps until every limit drops below this fraction */
+#define PACKET_QUEUE_LOW_WATERMARK 0.5
+/* a peer below its low watermark and this many packets is starving, see packetQueue_set_peer */
+#define PACKET_QUEUE_MIN_PACKETS 25
+/* past this multiple of any limit the producer waits even for a starving peer */
+#define PACKET_QUEUE_HARD_LIMIT 2.0
+/* ring slots used when no packet limit is given */
+#define PACKET_QUEUE_DEFAULT_CAPACITY 1024
+
+/*
+ * single producer / single consumer ring of AVPacket*.
+ * head is only written by the consumer and tail only by the producer, each on
+ * its own cache line; mutex and conds are touched only when a side has to sleep.
+ * slots own their AVPacket for the queue lifetime, packets are moved in and out
+ * so nothing is allocated once every slot has been used once.
+ * a flush never touches the ring from the flushing thread, it only moves
+ * serial on: the consumer drops stale packets as it meets them.
+ * a side that runs as an executor task instead of a thread sets its task,
+ * it is woken where a thread would be signalled.
+ */
 typedef struct PacketQueue {
-    AVPacketList *first_pkt, *last_pkt;
-    int nb_packets;
-    int size;
+    atomic_size_t head;
+    char pad0[SDL_CACHELINE_SIZE - sizeof(atomic_size_t)];
+    atomic_size_t tail;
+    char pad1[SDL_CACHELINE_SIZE - sizeof(atomic_size_t)];
+    
+    AVPacket **ring;
+    int64_t *enqueue_time;      /* per slot, monotonic microseconds */
+    int *serials;               /* per slot, serial the producer stamped */
+    size_t capacity;            /* power of two */
+    LatencyHistogram *latency;  /* optional, time packets spent queued */
+    
+    /* steady state proof: both stay flat once the ring wrapped */
+    atomic_int nb_node_allocs;  /* slot packets allocated so far, <= capacity */
+    atomic_int nb_pkt_copies;   /* packets that were not refcounted and had to be copied */
+    
+    atomic_int size;
+    atomic_llong duration;      /* buffered duration in time_base units */
+    AVRational time_base;
+    
+    /* capacity, 0 means no limit on that dimension */
+    int max_packets;
+    int max_size;
+    double max_duration;        /* seconds */
+    
+    atomic_int producer_waiting;
+    atomic_int consumer_waiting;
+    atomic_int abort_request;
+    atomic_int eof_serial;      /* serial the producer is done with, dequeue reports AVERROR_EOF once drained */
+    atomic_int serial;          /* bumped by a flush, packets of an older serial are dropped */
     SDL_mutex *mutex;
-    SDL_cond *cond;
+    SDL_cond *cond;             /* not empty */
+    SDL_cond *full_cond;        /* not full */
+    ExecTask *producer_task;
+    ExecTask *consumer_task;
+    
+    struct PacketQueue *peer;   /* fed by the same producer, set before either side runs */
+    atomic_int idle;            /* the producer feeds it nothing for now, it starves nobody */
 } PacketQueue;
 
-void packetQueue_init(PacketQueue *queue);
-int packetQueue_enqueue(PacketQueue *q, AVPacket *pkt);
-int packetQueue_dequeue(PacketQueue *q, AVPacket *pkt, int block, void *userdata);
+void packetQueue_init(PacketQueue *queue, int max_size, int max_packets, double max_duration);
+int packetQueue_enqueue(PacketQueue *q, AVPacket *pkt, int serial);
+/* for a producer task: AVERROR(EAGAIN) instead of sleeping, pkt is left untouched then */
+int packetQueue_try_enqueue(PacketQueue *q, AVPacket *pkt, int serial);
+/* block == 0 returns AVERROR(EAGAIN) on an empty queue, the consumer task is woken once there is more.
+ * at eof serial is the one that ended */
+int packetQueue_dequeue(PacketQueue *q, AVPacket *pkt, int block, void *userdata, int *serial);
+int packetQueue_wait_serial(PacketQueue *q, int serial, void *userdata);
+int packetQueue_serial(PacketQueue *q);
+int packetQueue_nb_packets(PacketQueue *q);
+void packetQueue_log_stats(PacketQueue *q, const char *tag);
+/* a no-op once a flush moved the queue past serial */
+void packetQueue_finish(PacketQueue *q, int serial);
+/*
+ * a and b share a producer: a full queue only holds it while the other has
+ * enough buffered, so badly interleaved input does not starve the other
+ * decoder. a queue overfills up to PACKET_QUEUE_HARD_LIMIT for that
+ */
+void packetQueue_set_peer(PacketQueue *a, PacketQueue *b);
+void packetQueue_set_idle(PacketQueue *q, int idle);
+void packetQueue_flush(PacketQueue *q, int serial);
+void packetQueue_abort(PacketQueue *q);
 int packetQueue_destory(PacketQueue *q);
 #endif /* packet_queue_h */
@@ -0,0 +1,180 @@
+//
+//  pcm_ring.c
+//  ffmpeg_proj
+//
+//  Created by HorsonChan on 2026/10/17.
+//
+
+#include "pcm_ring.h"
+#include <math.h>
+#include <libavutil/avutil.h>
+
+static size_t __free_space(PcmRing *ring) {
+    return ring->capacity - (atomic_load(&ring->tail) - atomic_load(&ring->head));
+}
+
+int pcmRing_init(PcmRing *ring, size_t capacity, int bytes_per_sec) {
+    size_t size = 1;
+    
+    memset(ring, 0, sizeof(PcmRing));
+    while (size < capacity)
+        size <<= 1;
+    ring->capacity = size;
+    ring->bytes_per_sec = bytes_per_sec;
+    ring->buf = av_malloc(size);
+    if (!ring->buf) {
+        av_log(NULL, AV_LOG_ERROR, "failed to allocate pcm ring\n");
+        return AVERROR(ENOMEM);
+    }
+    
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+    atomic_init(&ring->flush_pos, 0);
+    atomic_init(&ring->producer_waiting, 0);
+    atomic_init(&ring->abort_request, 0);
+    atomic_init(&ring->eof, 0);
+    atomic_init(&ring->nb_underruns, 0);
+    atomic_init(&ring->underrun_bytes, 0);
+    atomic_init(&ring->stamp_seq, 0);
+    atomic_init(&ring->stamp_pos, 0);
+    atomic_init(&ring->stamp_pts, NAN);
+    atomic_init(&ring->stamp_serial, -1);
+    
+    ring->space = SDL_CreateSemaphore(0);
+    return 0;
+}
+
+/* producer side, sleeps until len bytes fit. len has to be <= capacity */
+int pcmRing_wait_space(PcmRing *ring, size_t len) {
+    while (__free_space(ring) < len) {
+        if (atomic_load(&ring->abort_request))
+            return AVERROR_EXIT;
+        /* flag first, then re-check: the consumer moves head before it reads the flag and the
+         * semaphore counts, so a post between the check and the wait is kept. a stale post only
+         * costs another turn of the loop */
+        atomic_store(&ring->producer_waiting, 1);
+        if (__free_space(ring) < len && !atomic_load(&ring->abort_request))
+            SDL_SemWait(ring->space);
+        atomic_store(&ring->producer_waiting, 0);
+    }
+    return atomic_load(&ring->abort_request) ? AVERROR_EXIT : 0;
+}
+
+/* producer side, never blocks, returns how much was copied in */
+size_t pcmRing_write(PcmRing *ring, const uint8_t *data, size_t len) {
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    size_t offset = tail & (ring->capacity - 1);
+    size_t first = 0;
+    
+    if (len > __free_space(ring))
+        len = __free_space(ring);
+    first = FFMIN(len, ring->capacity - offset);
+    memcpy(ring->buf + offset, data, first);
+    memcpy(ring->buf, data + first, len - first);
+    atomic_store_explicit(&ring->tail, tail + len, memory_order_release);
+    return len;
+}
+
+size_t pcmRing_write_pos(PcmRing *ring) {
+    return atomic_load_explicit(&ring->tail, memory_order_relaxed);
+}
+
+/*
+ * producer side. stamp a position before writing up to it: the consumer may
+ * read the bytes as soon as tail moves and must not see them under an old stamp.
+ */
+void pcmRing_stamp(PcmRing *ring, size_t pos, double pts, int serial) {
+    unsigned seq = atomic_load_explicit(&ring->stamp_seq, memory_order_relaxed);
+    
+    atomic_store_explicit(&ring->stamp_seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&ring->stamp_pos, pos, memory_order_relaxed);
+    atomic_store_explicit(&ring->stamp_pts, pts, memory_order_relaxed);
+    atomic_store_explicit(&ring->stamp_serial, serial, memory_order_relaxed);
+    atomic_store_explicit(&ring->stamp_seq, seq + 2, memory_order_release);
+}
+
+/* pts of the byte at pos, from the latest stamp */
+static double __pts_at(PcmRing *ring, size_t pos, int *serial) {
+    unsigned seq0 = 0, seq1 = 0;
+    size_t stamp_pos = 0;
+    double stamp_pts = NAN;
+    
+    do {
+        seq0 = atomic_load_explicit(&ring->stamp_seq, memory_order_acquire);
+        stamp_pos = atomic_load_explicit(&ring->stamp_pos, memory_order_relaxed);
+        stamp_pts = atomic_load_explicit(&ring->stamp_pts, memory_order_relaxed);
+        *serial = atomic_load_explicit(&ring->stamp_serial, memory_order_relaxed);
+        atomic_thread_fence(memory_order_acquire);
+        seq1 = atomic_load_explicit(&ring->stamp_seq, memory_order_relaxed);
+    } while ((seq0 & 1) || seq0 != seq1);
+    
+    if (isnan(stamp_pts) || ring->bytes_per_sec <= 0)
+        return NAN;
+    return stamp_pts - (double)(int64_t)(stamp_pos - pos) / ring->bytes_per_sec;
+}
+
+/* consumer side, safe to call from the audio callback. pts is that of the first byte read */
+size_t pcmRing_read(PcmRing *ring, uint8_t *dst, size_t len, double *pts, int *serial) {
+    size_t old_head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    size_t flush_pos = atomic_load_explicit(&ring->flush_pos, memory_order_acquire);
+    size_t head = flush_pos > old_head ? flush_pos : old_head;
+    size_t avail = atomic_load_explicit(&ring->tail, memory_order_acquire) - head;
+    size_t offset = head & (ring->capacity - 1);
+    size_t n = FFMIN(len, avail);
+    size_t first = FFMIN(n, ring->capacity - offset);
+    
+    *pts = __pts_at(ring, head, serial);
+    memcpy(dst, ring->buf + offset, first);
+    memcpy(dst + first, ring->buf, n - first);
+    /* seq_cst so that the waiting flag is read after head moved */
+    atomic_store(&ring->head, head + n);
+    
+    if (n < len && !atomic_load(&ring->eof) && !atomic_load(&ring->abort_request)) {
+        atomic_fetch_add(&ring->nb_underruns, 1);
+        atomic_fetch_add(&ring->underrun_bytes, len - n);
+    }
+    if (head + n != old_head && atomic_exchange(&ring->producer_waiting, 0))
+        SDL_SemPost(ring->space);
+    return n;
+}
+
+/* what is still to be played, stale bytes before a flush do not count */
+size_t pcmRing_buffered(PcmRing *ring) {
+    size_t head = atomic_load(&ring->head);
+    size_t flush_pos = atomic_load(&ring->flush_pos);
+    return atomic_load(&ring->tail) - (flush_pos > head ? flush_pos : head);
+}
+
+void pcmRing_log_stats(PcmRing *ring, const char *tag) {
+    av_log(NULL, AV_LOG_INFO,
+           "[demo log] %s ring: %d underruns, %lld bytes of silence inserted\n",
+           tag,
+           atomic_load(&ring->nb_underruns),
+           (long long)atomic_load(&ring->underrun_bytes));
+}
+
+void pcmRing_finish(PcmRing *ring) {
+    atomic_store(&ring->eof, 1);
+}
+
+/* producer side: drop everything written so far and start over after eof */
+void pcmRing_flush(PcmRing *ring) {
+    atomic_store(&ring->flush_pos, atomic_load(&ring->tail));
+    atomic_store(&ring->eof, 0);
+}
+
+void pcmRing_abort(PcmRing *ring) {
+    atomic_store(&ring->abort_request, 1);
+    if (ring->space)
+        SDL_SemPost(ring->space);
+}
+
+void pcmRing_destory(PcmRing *ring) {
+    av_freep(&ring->buf);
+    atomic_store(&ring->head, atomic_load(&ring->tail));
+    if (ring->space) {
+        SDL_DestroySemaphore(ring->space);
+        ring->space = NULL;
+    }
+}
@@ -0,0 +1,68 @@
+//
+//  pcm_ring.h
+//  ffmpeg_proj
+//
+//  Created by HorsonChan on 2026/10/17.
+//
+
+#ifndef pcm_ring_h
+#define pcm_ring_h
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <SDL.h>
+
+/* how much decoded audio is kept ahead of the device */
+#define PCM_RING_DURATION 0.5
+
+/*
+ * single producer / single consumer byte ring for decoded pcm.
+ * the consumer is the SDL audio callback: it never locks, sleeps or allocates,
+ * it only copies out and advances head. the producer sleeps on a semaphore when
+ * the ring is full, the consumer posts it only if the producer said it waits.
+ * a flush is a producer side mark, the consumer jumps its head over the stale bytes.
+ * the producer also stamps the pts of a byte position, so the callback can tell
+ * which media time it hands to the device without asking the decoder for it.
+ */
+typedef struct PcmRing {
+    atomic_size_t head;
+    char pad0[SDL_CACHELINE_SIZE - sizeof(atomic_size_t)];
+    atomic_size_t tail;
+    char pad1[SDL_CACHELINE_SIZE - sizeof(atomic_size_t)];
+    atomic_size_t flush_pos;    /* consumer skips ahead to here, set by the producer */
+    
+    uint8_t *buf;
+    size_t capacity;            /* bytes, power of two */
+    
+    atomic_int producer_waiting;
+    atomic_int abort_request;
+    atomic_int eof;             /* producer is done, an empty ring is not an underrun */
+    
+    /* callback found less than it needed */
+    atomic_int nb_underruns;
+    atomic_llong underrun_bytes;
+    
+    /* pts at byte stamp_pos, written under stamp_seq by the producer */
+    atomic_uint stamp_seq;
+    atomic_size_t stamp_pos;
+    _Atomic double stamp_pts;
+    atomic_int stamp_serial;
+    int bytes_per_sec;
+    
+    SDL_sem *space;
+} PcmRing;
+
+int pcmRing_init(PcmRing *ring, size_t capacity, int bytes_per_sec);
+int pcmRing_wait_space(PcmRing *ring, size_t len);
+size_t pcmRing_write(PcmRing *ring, const uint8_t *data, size_t len);
+size_t pcmRing_write_pos(PcmRing *ring);
+void pcmRing_stamp(PcmRing *ring, size_t pos, double pts, int serial);
+size_t pcmRing_read(PcmRing *ring, uint8_t *dst, size_t len, double *pts, int *serial);
+size_t pcmRing_buffered(PcmRing *ring);
+void pcmRing_log_stats(PcmRing *ring, const char *tag);
+void pcmRing_finish(PcmRing *ring);
+void pcmRing_flush(PcmRing *ring);
+void pcmRing_abort(PcmRing *ring);
+void pcmRing_destory(PcmRing *ring);
+#endif /* pcm_ring_h */
@@ -0,0 +1,184 @@
+//
+//  pipeline_stats.c
+//  ffmpeg_proj
+//
+//  Created by HorsonChan on 2026/10/17.
+//
+
+#include <string.h>
+#include <signal.h>
+#include "pipeline_stats.h"
+#include <libavutil/log.h>
+
+static volatile sig_atomic_t dump_requested = 0;
+
+static int __bucket_index(int64_t us) {
+    int exp = 0;
+    
+    if (us < 16)
+        return us < 0 ? 0 : (int)us;
+    
+    while ((us >> exp) > 1)
+        exp++;
+    if (exp >= 40)
+        return LATENCY_HIST_BUCKETS - 1;
+    return 16 + (exp - 4) * LATENCY_HIST_SUB_BUCKETS +
+           (int)((us >> (exp - 3)) & (LATENCY_HIST_SUB_BUCKETS - 1));
+}
+
+/* upper bound of the bucket, which is what a percentile reports */
+static int64_t __bucket_value(int idx) {
+    int exp = 0, sub = 0;
+    
+    if (idx < 16)
+        return idx;
+    exp = (idx - 16) / LATENCY_HIST_SUB_BUCKETS + 4;
+    sub = (idx - 16) % LATENCY_HIST_SUB_BUCKETS;
+    return ((int64_t)(LATENCY_HIST_SUB_BUCKETS + sub + 1) << (exp - 3)) - 1;
+}
+
+void latencyHistogram_record(LatencyHistogram *h, int64_t us) {
+    int64_t max = 0;
+    
+    if (us < 0)
+        us = 0;
+    atomic_fetch_add_explicit(&h->buckets[__bucket_index(us)], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&h->count, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&h->sum, us, memory_order_relaxed);
+    
+    max = atomic_load_explicit(&h->max, memory_order_relaxed);
+    while (us > max &&
+           !atomic_compare_exchange_weak_explicit(&h->max, &max, us,
+                                                  memory_order_relaxed,
+                                                  memory_order_relaxed))
+        ;
+}
+
+int64_t latencyHistogram_percentile(LatencyHistogram *h, double p) {
+    int64_t count = atomic_load(&h->count);
+    int64_t target = (int64_t)(count * p + 0.5);
+    int64_t seen = 0;
+    
+    if (!count)
+        return 0;
+    if (target < 1)
+        target = 1;
+    
+    for (int i = 0; i < LATENCY_HIST_BUCKETS; i++) {
+        seen += atomic_load_explicit(&h->buckets[i], memory_order_relaxed);
+        if (seen >= target) {
+            int64_t value = __bucket_value(i);
+            int64_t max = atomic_load(&h->max);
+            return value < max ? value : max;
+        }
+    }
+    return atomic_load(&h->max);
+}
+
+void depthGauge_sample(DepthGauge *g, int depth) {
+    int max = atomic_load_explicit(&g->max, memory_order_relaxed);
+    
+    atomic_store_explicit(&g->last, depth, memory_order_relaxed);
+    atomic_fetch_add_explicit(&g->sum, depth, memory_order_relaxed);
+    atomic_fetch_add_explicit(&g->count, 1, memory_order_relaxed);
+    while (depth > max &&
+           !atomic_compare_exchange_weak_explicit(&g->max, &max, depth,
+                                                  memory_order_relaxed,
+                                                  memory_order_relaxed))
+        ;
+}
+
+static void __histogram_init(LatencyHistogram *h, const char *name) {
+    memset(h, 0, sizeof(LatencyHistogram));
+    h->name = name;
+}
+
+static void __gauge_init(DepthGauge *g, const char *name) {
+    memset(g, 0, sizeof(DepthGauge));
+    g->name = name;
+}
+
+void pipelineStats_init(PipelineStats *stats) {
+    __histogram_init(&stats->demux, "demux");
+    __histogram_init(&stats->io_stall, "read-ahead stall");
+    __histogram_init(&stats->video_queue, "video packet queue");
+    __histogram_init(&stats->audio_queue, "audio packet queue");
+    __histogram_init(&stats->video_decode, "video decode");
+    __histogram_init(&stats->audio_decode, "audio decode");
+    __histogram_init(&stats->convert, "convert");
+    __histogram_init(&stats->picture_queue, "picture queue");
+    __histogram_init(&stats->render, "render");
+    __histogram_init(&stats->present_late, "present lateness");
+    __histogram_init(&stats->seek, "seek to first frame");
+    __histogram_init(&stats->record, "recorder lag");
+    
+    __gauge_init(&stats->video_q_depth, "video packet queue");
+    __gauge_init(&stats->audio_q_depth, "audio packet queue");
+    __gauge_init(&stats->picture_q_depth, "picture queue");
+}
+
+static void __histogram_log(LatencyHistogram *h, const char *tag) {
+    int64_t count = atomic_load(&h->count);
+    
+    if (!count)
+        return;
+    av_log(NULL, AV_LOG_INFO,
+           "[%s] %-20s n %8lld  avg %9.3f ms  p50 %9.3f ms  p99 %9.3f ms  max %9.3f ms\n",
+           tag,
+           h->name,
+           (long long)count,
+           atomic_load(&h->sum) / 1000.0 / count,
+           latencyHistogram_percentile(h, 0.50) / 1000.0,
+           latencyHistogram_percentile(h, 0.99) / 1000.0,
+           atomic_load(&h->max) / 1000.0);
+}
+
+static void __gauge_log(DepthGauge *g, const char *tag) {
+    int64_t count = atomic_load(&g->count);
+    
+    if (!count)
+        return;
+    av_log(NULL, AV_LOG_INFO,
+           "[%s] %-20s depth now %d  avg %.1f  max %d\n",
+           tag,
+           g->name,
+           atomic_load(&g->last),
+           (double)atomic_load(&g->sum) / count,
+           atomic_load(&g->max));
+}
+
+void pipelineStats_dump(PipelineStats *stats, const char *tag) {
+    __histogram_log(&stats->demux, tag);
+    __histogram_log(&stats->io_stall, tag);
+    __histogram_log(&stats->video_queue, tag);
+    __histogram_log(&stats->audio_queue, tag);
+    __histogram_log(&stats->video_decode, tag);
+    __histogram_log(&stats->audio_decode, tag);
+    __histogram_log(&stats->convert, tag);
+    __histogram_log(&stats->picture_queue, tag);
+    __histogram_log(&stats->render, tag);
+    __histogram_log(&stats->present_late, tag);
+    __histogram_log(&stats->seek, tag);
+    __histogram_log(&stats->record, tag);
+    
+    __gauge_log(&stats->video_q_depth, tag);
+    __gauge_log(&stats->audio_q_depth, tag);
+    __gauge_log(&stats->picture_q_depth, tag);
+}
+
+static void __on_dump_signal(int sig) {
+    dump_requested = 1;
+}
+
+void pipelineStats_install_signal(void) {
+#ifdef SIGUSR1
+    signal(SIGUSR1, __on_dump_signal);
+#endif
+}
+
+int pipelineStats_dump_requested(void) {
+    if (!dump_requested)
+        return 0;
+    dump_requested = 0;
+    return 1;
+}
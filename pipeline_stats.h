@@ -0,0 +1,69 @@
+//
+//  pipeline_stats.h
+//  ffmpeg_proj
+//
+//  Created by HorsonChan on 2026/10/17.
+//
+
+#ifndef pipeline_stats_h
+#define pipeline_stats_h
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdatomic.h>
+
+/*
+ * log-linear buckets in microseconds: values below 16 get one bucket each,
+ * above that every power of two is split in 8, so a percentile is off by < 12.5%
+ */
+#define LATENCY_HIST_SUB_BUCKETS 8
+#define LATENCY_HIST_BUCKETS (16 + (40 - 4) * LATENCY_HIST_SUB_BUCKETS)
+
+typedef struct LatencyHistogram {
+    const char *name;
+    atomic_llong count;
+    atomic_llong sum;
+    atomic_llong max;
+    atomic_int buckets[LATENCY_HIST_BUCKETS];
+} LatencyHistogram;
+
+typedef struct DepthGauge {
+    const char *name;
+    atomic_int last;
+    atomic_int max;
+    atomic_llong sum;
+    atomic_llong count;
+} DepthGauge;
+
+typedef struct PipelineStats {
+    /* time spent in each stage, or waiting in front of it */
+    LatencyHistogram demux;             /* av_read_frame */
+    LatencyHistogram io_stall;          /* demuxer waiting on an empty read-ahead ring */
+    LatencyHistogram video_queue;       /* packet enqueue -> dequeue */
+    LatencyHistogram audio_queue;
+    LatencyHistogram video_decode;      /* packet dequeue -> avcodec_receive_frame */
+    LatencyHistogram audio_decode;
+    LatencyHistogram convert;           /* sws_scale over all slices */
+    LatencyHistogram picture_queue;     /* picture ready -> render_frame */
+    LatencyHistogram render;            /* texture upload + present */
+    LatencyHistogram present_late;      /* picture shown after its target time */
+    LatencyHistogram seek;              /* seek request -> first picture at the target */
+    LatencyHistogram record;            /* packet read -> written to the recording */
+    
+    DepthGauge video_q_depth;
+    DepthGauge audio_q_depth;
+    DepthGauge picture_q_depth;
+} PipelineStats;
+
+void latencyHistogram_record(LatencyHistogram *h, int64_t us);
+int64_t latencyHistogram_percentile(LatencyHistogram *h, double p);
+void depthGauge_sample(DepthGauge *g, int depth);
+
+void pipelineStats_init(PipelineStats *stats);
+void pipelineStats_dump(PipelineStats *stats, const char *tag);
+
+/* SIGUSR1 asks for a dump, the owner of the loop polls this */
+void pipelineStats_install_signal(void);
+int pipelineStats_dump_requested(void);
+
+#endif /* pipeline_stats_h */
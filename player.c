@@ -9,36 +9,235 @@
 #include "packet_queue.h"
 #include "common.h"
 #include "video_info.h"
+#include "yuv_upload.h"
 #include <libswresample/swresample.h>
 #include <libswscale/swscale.h>
 #include <libavutil/time.h>
+#include <libavutil/imgutils.h>
+#include <math.h>
 
 //SDL event
 #define USER_EVENT_VCODEC_READY SDL_USEREVENT + 1
-#define USER_REFRESH_FRAME SDL_USEREVENT + 2
+#define USER_EVENT_FRAME_READY SDL_USEREVENT + 2
+/* demux thread gave up, the event loop closes that player */
+#define USER_EVENT_PLAYER_DONE SDL_USEREVENT + 3
+
+/* players sharing one event loop */
+#define MAX_PLAYERS 64
+/* video wall: presented / dropped pictures of all players are logged this often */
+#define WALL_REPORT_INTERVAL 5000000
+/* shared workers: most a task does before it goes behind the other streams */
+#define DEMUX_STEP_PACKETS 16
+#define DECODE_STEP_PICTURES 4
+
+/* trick play: pictures a second the decoder is fed whatever the speed, and the speeds keys step through */
+#define TRICK_PLAY_FPS 8
+#define TRICK_PLAY_MIN_SPEED 2.0
+#define TRICK_PLAY_MAX_SPEED 32.0
 
 #define AV_SYNC_THRESHOLD 0.01
 #define AV_NOSYNC_THRESHOLD 10.0
+/* longest audio is held back waiting for the first picture, on top of decoder latency */
+#define AV_PREROLL_TIMEOUT 1.0
+/* presentation clock falls back to now if it is this far behind */
+#define AV_FRAME_TIMER_RESET 0.1
+
+/* share of late pictures, ewma over ~32, that raises or lowers the decoder skip level */
+#define FRAMEDROP_SKIP_ON 0.3
+#define FRAMEDROP_SKIP_OFF 0.02
+/* pictures in a row below FRAMEDROP_SKIP_OFF before a skip level is taken back */
+#define FRAMEDROP_CALM_FRAMES 120
+
+/* audio drift under a video or external master: averaged over this many frames, stretched by at most this much */
+#define AUDIO_DIFF_AVG_NB 20
+#define SAMPLE_CORRECTION_PERCENT_MAX 10
+
+/* scheduler: no deadline means sleep until an event (or a new picture) arrives */
+#define PRESENT_NO_DEADLINE INT64_MAX
+/* the event wait has millisecond resolution, the last stretch is slept with av_usleep */
+#define PRESENT_FINE_SLEEP_US 2000
+/* cap on any wait, so signals and quit are still noticed when idle */
+#define PRESENT_MAX_WAIT_MS 1000
+
+/* the clock the others follow, a missing stream falls back to the next one */
+static int get_master_sync_type(VideoInfo *info) {
+    /* trick play: audio is muted, the pictures pace themselves */
+    if (info->trick_speed)
+        return AV_SYNC_VIDEO_MASTER;
+    if (info->opts.sync_type == AV_SYNC_VIDEO_MASTER)
+        return info->has_video ? AV_SYNC_VIDEO_MASTER : AV_SYNC_AUDIO_MASTER;
+    if (info->opts.sync_type == AV_SYNC_AUDIO_MASTER)
+        return info->has_audio && !info->headless ? AV_SYNC_AUDIO_MASTER : AV_SYNC_EXTERNAL_CLOCK;
+    return AV_SYNC_EXTERNAL_CLOCK;
+}
+
+/* lock free from any thread, NAN until the master runs on the current seek serial */
+static double get_master_clock(VideoInfo *info) {
+    SyncClock *c = NULL;
+    
+    switch (get_master_sync_type(info)) {
+        case AV_SYNC_VIDEO_MASTER:
+            c = &info->vidclk;
+            break;
+        case AV_SYNC_AUDIO_MASTER:
+            c = &info->audclk;
+            break;
+        default:
+            c = &info->extclk;
+            break;
+    }
+    if (syncClock_serial(c) != info->seek_serial)
+        return NAN;
+    return syncClock_get(c);
+}
+
+/*
+ * audio is not the master: average its lead over the master and, once the
+ * average is beyond a device buffer, ask for a few percent more or fewer
+ * samples. swr stretches them in, too little to be heard as a pitch change
+ */
+static int synchronize_audio(VideoInfo *info, int nb_samples) {
+    int wanted_nb_samples = nb_samples;
+    int min_nb_samples = 0, max_nb_samples = 0;
+    double diff = 0, avg_diff = 0;
+    
+    if (get_master_sync_type(info) == AV_SYNC_AUDIO_MASTER ||
+        syncClock_serial(&info->audclk) != info->audio_serial)
+        return nb_samples;
+    
+    diff = syncClock_get(&info->audclk) - get_master_clock(info);
+    if (isnan(diff) || fabs(diff) >= AV_NOSYNC_THRESHOLD) {
+        /* too far off to be drift, start averaging over */
+        info->audio_diff_avg_count = 0;
+        info->audio_diff_cum = 0;
+        return nb_samples;
+    }
+    
+    info->audio_diff_cum = diff + info->audio_diff_avg_coef * info->audio_diff_cum;
+    if (info->audio_diff_avg_count < AUDIO_DIFF_AVG_NB) {
+        info->audio_diff_avg_count++;
+        return nb_samples;
+    }
+    
+    avg_diff = info->audio_diff_cum * (1.0 - info->audio_diff_avg_coef);
+    if (fabs(avg_diff) >= info->audio_diff_threshold) {
+        wanted_nb_samples = nb_samples + (int)(diff * info->a_c->sample_rate);
+        min_nb_samples = nb_samples * (100 - SAMPLE_CORRECTION_PERCENT_MAX) / 100;
+        max_nb_samples = nb_samples * (100 + SAMPLE_CORRECTION_PERCENT_MAX) / 100;
+        wanted_nb_samples = av_clip(wanted_nb_samples, min_nb_samples, max_nb_samples);
+    }
+    return wanted_nb_samples;
+}
+
+/* SDL only takes interleaved samples, planar decoder output still goes through swr */
+static SDL_AudioFormat sdl_audio_format(enum AVSampleFormat fmt) {
+    switch (av_get_packed_sample_fmt(fmt)) {
+        case AV_SAMPLE_FMT_U8:
+            return AUDIO_U8;
+        case AV_SAMPLE_FMT_S16:
+            return AUDIO_S16SYS;
+        case AV_SAMPLE_FMT_S32:
+            return AUDIO_S32SYS;
+        default:
+            /* float, and double which SDL has no format for */
+            return AUDIO_F32SYS;
+    }
+}
 
-#define MAX_AUDIOQ_SIZE (5 * 16 * 1024)
-#define MAX_VIDEOQ_SIZE (5 * 256 * 1024)
+static enum AVSampleFormat av_audio_format(SDL_AudioFormat fmt) {
+    switch (fmt) {
+        case AUDIO_U8:
+            return AV_SAMPLE_FMT_U8;
+        case AUDIO_S16SYS:
+            return AV_SAMPLE_FMT_S16;
+        case AUDIO_S32SYS:
+            return AV_SAMPLE_FMT_S32;
+        case AUDIO_F32SYS:
+            return AV_SAMPLE_FMT_FLT;
+        default:
+            return AV_SAMPLE_FMT_NONE;
+    }
+}
+
+static int audio_params_set(AudioParams *params, enum AVSampleFormat fmt, int channels, int64_t channel_layout, int freq) {
+    params->fmt = fmt;
+    params->channels = channels;
+    params->channel_layout = channel_layout && av_get_channel_layout_nb_channels(channel_layout) == channels ?
+                             channel_layout : av_get_default_channel_layout(channels);
+    params->freq = freq;
+    params->frame_size = av_samples_get_buffer_size(NULL, channels, 1, fmt, 1);
+    params->bytes_per_sec = av_samples_get_buffer_size(NULL, channels, freq, fmt, 1);
+    return params->frame_size > 0 && params->bytes_per_sec > 0 ? 0 : AVERROR(EINVAL);
+}
+
+/*
+ * swr only runs when the device takes other pcm than the decoder gives, or
+ * once the audio has to be stretched towards another master. rebuilt when
+ * the decoder output changes midstream
+ */
+static int audio_swr_update(VideoInfo *info, AVFrame *frame, int compensate) {
+    AudioParams *src = &info->audio_src;
+    AudioParams *tgt = &info->audio_tgt;
+    int64_t layout = frame->channel_layout &&
+                     av_get_channel_layout_nb_channels(frame->channel_layout) == frame->channels ?
+                     frame->channel_layout : av_get_default_channel_layout(frame->channels);
+    
+    if (frame->format == src->fmt && layout == src->channel_layout && frame->sample_rate == src->freq &&
+        (info->swr_ctx || !compensate))
+        return 0;
+    
+    swr_free(&info->swr_ctx);
+    if (audio_params_set(src, frame->format, frame->channels, layout, frame->sample_rate) < 0)
+        return AVERROR(EINVAL);
+    /* same pcm on both sides, frames go to the ring as they are */
+    if (!compensate && src->fmt == tgt->fmt && src->channel_layout == tgt->channel_layout && src->freq == tgt->freq)
+        return 0;
+    
+    if (!(info->swr_ctx = swr_alloc_set_opts(NULL,
+                                             tgt->channel_layout, tgt->fmt, tgt->freq,
+                                             src->channel_layout, src->fmt, src->freq,
+                                             0, NULL)) ||
+        swr_init(info->swr_ctx) < 0) {
+        av_log(NULL, AV_LOG_ERROR,
+               "[demo log] failed to set up conversion from %s %d Hz %d channels to %s %d Hz %d channels\n",
+               av_get_sample_fmt_name(src->fmt), src->freq, src->channels,
+               av_get_sample_fmt_name(tgt->fmt), tgt->freq, tgt->channels);
+        swr_free(&info->swr_ctx);
+        return AVERROR(EINVAL);
+    }
+    av_log(NULL, AV_LOG_VERBOSE,
+           "[demo log] audio: %s %d Hz %d channels converted to %s %d Hz %d channels%s\n",
+           av_get_sample_fmt_name(src->fmt), src->freq, src->channels,
+           av_get_sample_fmt_name(tgt->fmt), tgt->freq, tgt->channels,
+           compensate ? " for clock compensation" : "");
+    return 0;
+}
 
-static int __decode_audio(VideoInfo *info, uint8_t *audio_buf, int buf_size) {
+/* pcm of the next frame in *audio_data, valid until the next call; returns its size */
+static int __decode_audio(VideoInfo *info, const uint8_t **audio_data) {
     int rc = 0;
     int len = 0;
 
     PacketQueue *audio_q = info->audio_q;
-    SwrContext *swr_ctx = info->swr_ctx;
     AVCodecContext *c = info->a_c;
+    uint8_t *audio_buf = info->audio_buf;
     
     AVPacket pkt;
-    static AVFrame frame;
+    AVFrame *frame = info->audio_frame;
     int data_size = 0;
+    int serial = 0;
+    int skip = 0;
+    int wanted_nb_samples = 0;
+    double frame_duration = 0;
+    
+    av_init_packet(&pkt);
+    pkt.data = NULL;
+    pkt.size = 0;
 
     while (1) {
         if (info->quit) break;
         /* read data from codec */
-        rc = avcodec_receive_frame(c, &frame);
+        rc = avcodec_receive_frame(c, frame);
         if (rc == AVERROR(EAGAIN) || rc == AVERROR_EOF) {
             rc = 0;
 
@@ -48,30 +247,86 @@ static int __decode_audio(VideoInfo *info, uint8_t *audio_buf, int buf_size) {
             goto __exit;
 
         } else {
-            len = swr_convert(swr_ctx,
-                              &audio_buf,
-                              buf_size/2/2,
-                              (const uint8_t **)frame.data,
-                              frame.nb_samples);
-            data_size = len * 2 * 2;
+            info->nb_audio_frames++;
+            if (frame->reordered_opaque > 0) {
+                latencyHistogram_record(&info->stats.audio_decode,
+                                        av_gettime_relative() - frame->reordered_opaque);
+            }
+            wanted_nb_samples = synchronize_audio(info, frame->nb_samples);
+            if ((rc = audio_swr_update(info, frame, wanted_nb_samples != frame->nb_samples)) < 0)
+                goto __exit;
+            
+            if (info->swr_ctx) {
+                /* compensation counts output samples */
+                if (wanted_nb_samples != frame->nb_samples &&
+                    swr_set_compensation(info->swr_ctx,
+                                         (wanted_nb_samples - frame->nb_samples) * info->audio_tgt.freq / frame->sample_rate,
+                                         wanted_nb_samples * info->audio_tgt.freq / frame->sample_rate) < 0) {
+                    av_log(NULL, AV_LOG_WARNING, "[demo log] swr_set_compensation failed\n");
+                }
+                len = swr_convert(info->swr_ctx,
+                                  &audio_buf,
+                                  sizeof(info->audio_buf) / info->audio_tgt.frame_size,
+                                  (const uint8_t **)frame->extended_data,
+                                  frame->nb_samples);
+                if (len < 0) {
+                    rc = len;
+                    av_log(NULL, AV_LOG_ERROR, "[demo log] swr_convert failed\n");
+                    goto __exit;
+                }
+                data_size = len * info->audio_tgt.frame_size;
+                *audio_data = audio_buf;
+            } else {
+                /* already what the device takes, no copy */
+                data_size = frame->nb_samples * info->audio_tgt.frame_size;
+                *audio_data = frame->data[0];
+            }
+            
+            /* ensure the audio clock is correct even without pkt.pts, a stretched frame still covers its input */
+            frame_duration = (double)frame->nb_samples / c->sample_rate;
+            info->audio_decode_clock += frame_duration;
             
-            /* ensure the audio clock is correct even without pkt.pts */
-            info->audio_clock += ((double)data_size / (double)info->audio_data_size_ps);
+            /* accurate seek: trim pcm before the target, down to the sample */
+            if (info->audio_skip_until > info->audio_decode_clock - frame_duration) {
+                if (info->audio_decode_clock <= info->audio_skip_until)
+                    continue;
+                skip = (int)((info->audio_skip_until - info->audio_decode_clock) * info->audio_data_size_ps) + data_size;
+                skip -= skip % info->audio_tgt.frame_size;
+                *audio_data += skip;
+                data_size -= skip;
+                info->audio_skip_until = 0;
+            }
             return data_size;
         }
 
         /* get pkt from the audio queue */
-        rc = packetQueue_dequeue(audio_q, &pkt, 1, info);
+        rc = packetQueue_dequeue(audio_q, &pkt, 1, info, &serial);
+        if ((rc == 0 || rc == AVERROR_EOF) && serial != info->audio_serial) {
+            /* first packet or eof after a seek: forget decoder state and the pcm not yet played */
+            avcodec_flush_buffers(c);
+            if (info->pcm_ring) {
+                pcmRing_flush(info->pcm_ring);
+            }
+            info->audio_serial = serial;
+            info->audio_skip_until = info->opts.accurate_seek ? info->seek_target : 0;
+        }
+        if (rc == AVERROR_EOF) {
+            /* drain what the decoder holds, the second time around we are done */
+            if ((rc = avcodec_send_packet(c, NULL)) == AVERROR_EOF)
+                goto __exit;
+            continue;
+        }
         if (rc < 0) {
             av_log(NULL, AV_LOG_ERROR, "failed to dequeue packet\n");
             goto __exit;
         }
 
-        /* send pkt to decoder */
+        /* send pkt to decoder, dequeue time rides along to the frame */
+        c->reordered_opaque = av_gettime_relative();
         rc = avcodec_send_packet(c, &pkt);
         /* record current play pts */
         if (pkt.pts != AV_NOPTS_VALUE) {
-            info->audio_clock = av_q2d(info->a_c->time_base) * pkt.pts;
+            info->audio_decode_clock = av_q2d(info->a_st->time_base) * pkt.pts;
         }
         av_packet_unref(&pkt);
         
@@ -83,46 +338,111 @@ __exit:
 
 void audio_callback(void *userdata, Uint8 * stream, int len) {
     VideoInfo *info = (VideoInfo *)userdata;
-    int read_len = 0;
+    size_t read_len = 0;
+    double callback_time = syncClock_now();
+    double pts = NAN;
+    int serial = 0;
 
     //must do, otherwise SDL_MixAudio will boom your head, and this function will always call back, so the audio clock is not accurate
-    memset(stream, 0, len);
+    memset(stream, info->audio_spec.silence, len);
+    
+    if (info->quit) return;
+    
+    /* real-time thread: copy what the decode thread has ready, the rest stays silent */
+    if (len > info->audio_mix_size)
+        len = info->audio_mix_size;
+    read_len = pcmRing_read(info->pcm_ring, info->audio_mix_buf, len, &pts, &serial);
+    SDL_MixAudioFormat(stream, info->audio_mix_buf, info->audio_spec.format, (Uint32)read_len, 50);
+    
+    /* first pcm is heard after the buffer queued ahead of it, main thread reports it */
+    if (read_len && !atomic_load_explicit(&info->first_audio_time, memory_order_relaxed)) {
+        atomic_store(&info->first_audio_time,
+                     av_gettime_relative() +
+                     (int64_t)info->audio_mix_size * 1000000 / info->audio_data_size_ps);
+    }
+    
+    /* what was just copied is heard once the device played out the buffer queued ahead of it */
+    if (!isnan(pts)) {
+        syncClock_set_at(&info->audclk,
+                         pts - (double)info->audio_mix_size / info->audio_data_size_ps,
+                         serial,
+                         callback_time);
+    }
+}
+
+/*
+ * hand decoded pcm to the callback. every chunk is stamped with the pts at
+ * its end, the callback works out the audio clock from the stamp
+ */
+static int audio_ring_push(VideoInfo *info, const uint8_t *data, int len) {
+    int rc = 0;
+    PcmRing *ring = info->pcm_ring;
+    /* frames bigger than the ring go in pieces */
+    size_t chunk_max = ring->capacity / 2;
+    double end_clock = info->audio_decode_clock;
     
     while (len > 0) {
+        size_t n = FFMIN((size_t)len, chunk_max);
+        if ((rc = pcmRing_wait_space(ring, n)) < 0)
+            break;
         
-        if (info->quit) break;
-        
-        if (info->audio_pos >= info->audio_end) {
-            read_len = __decode_audio(info,
-                                      info->audio_buf,
-                                      MAX_AUDIO_FRAME_SIZE * 3);
-
-            if (read_len < 0) {
-                av_log(NULL, AV_LOG_ERROR, "error occured when audio codec decode pkt\n");
-                return;
-            }
+        len -= (int)n;
+        pcmRing_stamp(ring,
+                      pcmRing_write_pos(ring) + n,
+                      end_clock - (double)len / (double)info->audio_data_size_ps,
+                      info->audio_serial);
+        pcmRing_write(ring, data, n);
+        data += n;
+    }
+    return rc;
+}
 
-            info->audio_pos = info->audio_buf;
-            info->audio_end = info->audio_buf + read_len;
+/*
+ * decodes ahead of the device into pcm_ring, so demux or decode stalls are
+ * absorbed by the ring instead of the callback. headless there is no device
+ * and the pcm is dropped right after decoding
+ */
+static int audio_decode_thread(void *data) {
+    VideoInfo *info = (VideoInfo *)data;
+    int rc = 0;
+    
+    const uint8_t *audio_data = NULL;
+    
+    while (!info->quit) {
+        rc = __decode_audio(info, &audio_data);
+        if (rc == AVERROR_EOF && info->pcm_ring) {
+            /* played to the end, stay around in case the user seeks back */
+            pcmRing_finish(info->pcm_ring);
+            if ((rc = packetQueue_wait_serial(info->audio_q, info->audio_serial, info)) < 0)
+                break;
+            continue;
         }
-
-        int cur_size = (int)(info->audio_end - info->audio_pos);
-
-        int copy_len = cur_size < len ? cur_size : len;
-        SDL_MixAudio(stream, info->audio_pos, copy_len, 50);
-
-        len -= copy_len;
-        stream += copy_len;
-        info->audio_pos += copy_len;
+        if (rc < 0) break;
+        if (info->pcm_ring && (rc = audio_ring_push(info, audio_data, rc)) < 0) break;
+    }
+    if (info->pcm_ring) {
+        pcmRing_finish(info->pcm_ring);
+    }
+    
+    SDL_LockMutex(info->p_mutex);
+    info->audio_cpu = thread_cpu_time();
+    info->audio_eof = 1;
+    SDL_CondBroadcast(info->p_cond);
+    SDL_UnlockMutex(info->p_mutex);
+    
+    if (rc < 0 && rc != AVERROR_EOF && rc != AVERROR_EXIT) {
+        av_log(NULL, AV_LOG_ERROR, "error occured when audio codec decode pkt\n");
     }
+    return rc == AVERROR_EOF ? 0 : rc;
 }
 
 static int open_codec(AVCodec **codec,
                       AVCodecContext **c,
-                      AVStream *src_st) {
+                      AVStream *src_st,
+                      const PlayerOptions *opts) {
     int rc = 0;
     CHECK_ERROR(!(*codec =
-                  avcodec_find_decoder(src_st->codec->codec_id)),
+                  avcodec_find_decoder(src_st->codecpar->codec_id)),
                 "failed to find compatible decoder",
                 AVERROR_UNKNOWN,
                 __exit);
@@ -132,14 +452,28 @@ static int open_codec(AVCodec **codec,
                 AVERROR_UNKNOWN,
                 __exit)
     
-    CHECK_ERROR((rc = avcodec_copy_context(*c, src_st->codec)),
-                "failed to copy codec context to dst codec_ctx",
+    /* codecpar, st->codec is only filled in by avformat_find_stream_info */
+    CHECK_ERROR(((rc = avcodec_parameters_to_context(*c, src_st->codecpar)) < 0),
+                "failed to copy codec parameters to dst codec_ctx",
                 0, __exit)
+    (*c)->pkt_timebase = src_st->time_base;
+    
+    /* auto means one thread per core, the codec drops what it can not use; shared workers already spread streams over the cores */
+    (*c)->thread_count = opts->decoder_threads > 0 ? opts->decoder_threads :
+                         opts->workers ? 1 : SDL_GetCPUCount();
+    (*c)->thread_type = opts->decoder_thread_type;
     
     CHECK_ERROR(((rc = avcodec_open2(*c, *codec, NULL)) < 0),
                 "failed to open decoder",
                 0, __exit)
     
+    av_log(NULL, AV_LOG_VERBOSE,
+           "[demo log] %s decoder: %d threads, %s threading\n",
+           (*codec)->name,
+           (*c)->thread_count,
+           (*c)->active_thread_type & FF_THREAD_FRAME ? "frame" :
+           (*c)->active_thread_type & FF_THREAD_SLICE ? "slice" : "no");
+    
 __exit:
     return rc;
 }
@@ -149,72 +483,149 @@ static int init_audio_component(VideoInfo *info) {
     
     int rc = 0;
     AVCodec *a_codec = NULL;
-    SDL_AudioSpec spec;
+    SDL_AudioSpec spec, obtained;
     
     //ffmpeg
     info->a_st = info->fmt_ctx->streams[info->audio_stream_idx];
-    CHECK_ERROR(((rc = open_codec(&a_codec, &info->a_c, info->a_st)) < 0),
+    CHECK_ERROR(((rc = open_codec(&a_codec,
+                                  &info->a_c,
+                                  info->a_st,
+                                  &info->opts)) < 0),
                 "open audio codec failed",
                 0,
                 __exit)
     
-    /* after resample sample_fmt == S16, so why 2 below */
-    info->audio_data_size_ps = 2 * info->a_c->channels * info->a_c->sample_rate;
-    CHECK_ERROR(info->audio_data_size_ps <= 0,
-                "caculate audio data size ps error, result <= 0",
-                AVERROR_UNKNOWN,
-                __exit)
-    
-    CHECK_ERROR(!(info->swr_ctx = swr_alloc()),
-                "failed to allocate swrContext",
-                AVERROR_UNKNOWN,
+    CHECK_ERROR(!(info->audio_frame = av_frame_alloc()),
+                "failed to allocate audio frame",
+                AVERROR(ENOMEM),
                 __exit)
+    /* swr is set up from the first decoded frame, see audio_swr_update */
+    info->audio_src.fmt = AV_SAMPLE_FMT_NONE;
+    
+    if (info->headless) {
+        /* no device, pcm only has to be interleaved. float while the format waits for the first frame */
+        CHECK_ERROR(((rc = audio_params_set(&info->audio_tgt,
+                                            info->a_c->sample_fmt == AV_SAMPLE_FMT_NONE ?
+                                            AV_SAMPLE_FMT_FLT : av_get_packed_sample_fmt(info->a_c->sample_fmt),
+                                            info->a_c->channels,
+                                            info->a_c->channel_layout,
+                                            info->a_c->sample_rate)) < 0),
+                    "unsupported audio format",
+                    0, __exit)
+        info->audio_data_size_ps = info->audio_tgt.bytes_per_sec;
+        info->audio_t = SDL_CreateThread(audio_decode_thread, "audio_thread", info);
+        goto __exit;
+    }
     
-    int64_t in_channel_layout = av_get_default_channel_layout(info->a_c->channels);
-    int64_t out_channel_layout = in_channel_layout; //AV_CH_LAYOUT_STEREO;
-    swr_alloc_set_opts(info->swr_ctx,
-                       out_channel_layout,
-                       AV_SAMPLE_FMT_S16,
-                       info->a_c->sample_rate,
-                       in_channel_layout,
-                       info->a_c->sample_fmt,
-                       info->a_c->sample_rate,
-                       0, NULL);
-    
-    CHECK_ERROR(((rc = swr_init(info->swr_ctx)) < 0),
-                "failed to init swrContext",
-                0, __exit)
-    
-    //SDL initialization
+    //SDL initialization, ask for the decoder's own format
     spec.freq = info->a_c->sample_rate;
-    spec.format = AUDIO_S16SYS;
+    spec.format = sdl_audio_format(info->a_c->sample_fmt);
     spec.channels = info->a_c->channels;
     spec.silence = 0;
     spec.callback = audio_callback;
     spec.userdata = info;
     spec.samples = SDL_AUDIO_BUFFER_SIZE;
-    CHECK_ERROR(((rc = SDL_OpenAudio(&spec, NULL)) < 0),
+    /* a device per player; whatever it settles on is what we convert to, SDL does not convert again */
+    info->audio_dev = SDL_OpenAudioDevice(NULL, 0, &spec, &obtained,
+                                          SDL_AUDIO_ALLOW_FORMAT_CHANGE |
+                                          SDL_AUDIO_ALLOW_FREQUENCY_CHANGE |
+                                          SDL_AUDIO_ALLOW_CHANNELS_CHANGE);
+    if (info->audio_dev && av_audio_format(obtained.format) == AV_SAMPLE_FMT_NONE) {
+        /* a format we have no name for, let SDL convert from S16 after all */
+        SDL_CloseAudioDevice(info->audio_dev);
+        spec.format = AUDIO_S16SYS;
+        info->audio_dev = SDL_OpenAudioDevice(NULL, 0, &spec, &obtained,
+                                              SDL_AUDIO_ALLOW_FREQUENCY_CHANGE |
+                                              SDL_AUDIO_ALLOW_CHANNELS_CHANGE);
+    }
+    CHECK_ERROR(!info->audio_dev,
                 "failed to open audio device",
-                0, __exit);
+                AVERROR_UNKNOWN,
+                __exit);
+    info->audio_spec = obtained;
+    
+    /* the decoder's channel order, as long as the device kept the channel count */
+    CHECK_ERROR(((rc = audio_params_set(&info->audio_tgt,
+                                        av_audio_format(obtained.format),
+                                        obtained.channels,
+                                        obtained.channels == info->a_c->channels ? info->a_c->channel_layout : 0,
+                                        obtained.freq)) < 0),
+                "unsupported audio device format",
+                0, __exit)
+    info->audio_data_size_ps = info->audio_tgt.bytes_per_sec;
+    av_log(NULL, AV_LOG_VERBOSE,
+           "[demo log] audio device: %s %d Hz %d channels, decoder gives %s %d Hz %d channels\n",
+           av_get_sample_fmt_name(info->audio_tgt.fmt), obtained.freq, obtained.channels,
+           av_get_sample_fmt_name(info->a_c->sample_fmt), info->a_c->sample_rate, info->a_c->channels);
+    
+    CHECK_ERROR(!(info->pcm_ring = malloc(sizeof(PcmRing))),
+                "failed to allocate pcm ring",
+                AVERROR(ENOMEM),
+                __exit)
+    CHECK_ERROR(((rc = pcmRing_init(info->pcm_ring,
+                                     info->audio_data_size_ps * PCM_RING_DURATION,
+                                     info->audio_data_size_ps)) < 0),
+                "failed to init pcm ring",
+                0, __exit)
+    
+    /* scratch for the callback, sized once here so the callback never allocates */
+    info->audio_mix_size = obtained.size;
+    /* drift below one device buffer is within what the callback can tell apart */
+    info->audio_diff_threshold = (double)obtained.size / info->audio_data_size_ps;
+    info->audio_diff_avg_coef = exp(log(0.01) / AUDIO_DIFF_AVG_NB);
+    CHECK_ERROR(!(info->audio_mix_buf = av_malloc(obtained.size)),
+                "failed to allocate audio mix buffer",
+                AVERROR(ENOMEM),
+                __exit)
     
-    SDL_PauseAudio(0);
+    /* start filling the ring, the device is still paused */
+    info->audio_t = SDL_CreateThread(audio_decode_thread, "audio_thread", info);
     
     /* record time of begin audio render, so as video */
     info->refresh_time = av_gettime() / 1000000.0;
     info->last_frame_delay = 40e-3;
+    
+    /* with video, audio is held until the first picture is up (see refresh_frame) */
+    SDL_LockMutex(info->w_mutex);
+    info->audio_opened = 1;
+    if (!info->has_video || info->audio_started) {
+        info->audio_started = 1;
+        SDL_PauseAudioDevice(info->audio_dev, 0);
+    }
+    SDL_UnlockMutex(info->w_mutex);
 __exit:
     return rc;
 }
 
 
-AVFrame *sws_frame_alloc(VideoInfo *info) {
-    
-    AVFrame *r_vframe = av_frame_alloc();
-    r_vframe->width = info->v_c->width;
-    r_vframe->height = info->v_c->height;
-    r_vframe->format = AV_PIX_FMT_YUV420P;
-    av_frame_get_buffer(r_vframe, 0);
-    return r_vframe;
+/* converted pictures have the target size, the texture follows it (see render_frame) */
+static int sws_frame_get_buffer(VideoInfo *info, AVFrame *r_vframe, int width, int height) {
+    return framePool_get(&info->picture_pool, r_vframe, width, height, AV_PIX_FMT_YUV420P);
+}
+
+/*
+ * conversion target: the drawable where it is smaller than the picture,
+ * pixels the window cannot show are not worth uploading. never scaled up
+ * here, the renderer stretches the texture for free
+ */
+static void picture_target_size(VideoInfo *info, AVFrame *frame, int *width, int *height) {
+    int out_w = atomic_load(&info->output_width);
+    int out_h = atomic_load(&info->output_height);
+    
+    *width = frame->width;
+    *height = frame->height;
+    /* even, the chroma planes are half size */
+    if (out_w > 0 && out_w < frame->width)
+        *width = FFMAX(out_w & ~1, 2);
+    if (out_h > 0 && out_h < frame->height)
+        *height = FFMAX(out_h & ~1, 2);
+}
+
+/* 4:2:0 at the target size is written into the IYUV texture by render_frame itself, see yuv_upload.c */
+static int frame_is_renderable(AVFrame *frame, int width, int height) {
+    return yuvUpload_supported(frame->format) &&
+           frame->width == width &&
+           frame->height == height;
 }
 
 static double sync_video_clock(VideoInfo *info,
@@ -237,50 +648,391 @@ static double sync_video_clock(VideoInfo *info,
     return pts;
 }
 
-static int frame_enqueue(AVFrame *frame, VideoInfo *info) {
+static void picture_buffer_count(VideoInfo *info, int delta) {
+    SDL_LockMutex(info->p_mutex);
+    info->video_buf_allocated += delta;
+    SDL_UnlockMutex(info->p_mutex);
+}
+
+static void frame_publish(VideoInfo *info, FrameInfo *frame_info) {
+    frame_info->ready_time = av_gettime_relative();
+    SDL_LockMutex(info->p_mutex);
+    info->video_buf_size++;
+    SDL_CondBroadcast(info->p_cond);
+    /* scheduler ran dry and sleeps on the event queue, one event wakes it */
+    if (info->present_waiting) {
+        SDL_Event event;
+        info->present_waiting = 0;
+        event.type = USER_EVENT_FRAME_READY;
+        event.user.data1 = info;
+        SDL_PushEvent(&event);
+    }
+    SDL_UnlockMutex(info->p_mutex);
+}
+
+/* runs on the sws worker that finished the last slice */
+static void frame_converted(void *opaque, int64_t convert_time) {
+    FrameInfo *frame_info = (FrameInfo *)opaque;
+    VideoInfo *info = frame_info->owner;
+    latencyHistogram_record(&info->stats.convert, convert_time);
+    frame_publish(info, frame_info);
+}
+
+static SwsPool *get_sws_pool(VideoInfo *info) {
+    if (!info->sws_pool) {
+        int nb_threads = info->opts.sws_threads > 0 ? info->opts.sws_threads :
+                         info->opts.workers ? 1 :
+                         FFMAX(1, SDL_GetCPUCount() / 2);
+        info->sws_pool = malloc(sizeof(SwsPool));
+        if (swsPool_init(info->sws_pool, nb_threads) < 0) {
+            swsPool_destory(info->sws_pool);
+            free(info->sws_pool);
+            info->sws_pool = NULL;
+        }
+    }
+    return info->sws_pool;
+}
+
+/* end of the frame on the stream clock, a frame without timestamp never ends */
+static double frame_end_time(VideoInfo *info, AVFrame *frame) {
+    AVRational frame_rate = info->v_st->avg_frame_rate;
+    double duration = frame_rate.num && frame_rate.den ? 1.0 / av_q2d(frame_rate) : 40e-3;
+    
+    if (frame->best_effort_timestamp == AV_NOPTS_VALUE)
+        return INFINITY;
+    if (frame->pkt_duration > 0)
+        duration = frame->pkt_duration * av_q2d(info->v_st->time_base);
+    return frame->best_effort_timestamp * av_q2d(info->v_st->time_base) + duration;
+}
+
+/*
+ * sustained lag: first stop filtering, then stop decoding non reference
+ * frames. each step waits for a fresh late ratio, and steps back after a calm spell
+ */
+static void update_decoder_skip(VideoInfo *info, int late) {
+    int level = info->skip_level;
+    
+    info->late_ratio += ((late ? 1.0 : 0.0) - info->late_ratio) / 32;
+    /* trick play owns skip_frame, see video_decoder_reset */
+    if (!info->opts.skip_nonref || info->stream_speed)
+        return;
+    
+    if (info->late_ratio > FRAMEDROP_SKIP_ON && level < 2) {
+        level++;
+        info->late_ratio = 0;
+        info->skip_calm_count = 0;
+    } else if (info->late_ratio < FRAMEDROP_SKIP_OFF && level > 0) {
+        if (++info->skip_calm_count > FRAMEDROP_CALM_FRAMES) {
+            level--;
+            info->skip_calm_count = 0;
+        }
+    } else {
+        info->skip_calm_count = 0;
+    }
+    if (level == info->skip_level)
+        return;
+    
+    info->skip_level = level;
+    info->v_c->skip_loop_filter = level >= 1 ? AVDISCARD_NONREF : AVDISCARD_DEFAULT;
+    info->v_c->skip_frame = level >= 2 ? AVDISCARD_NONREF : AVDISCARD_DEFAULT;
+    av_log(NULL, AV_LOG_VERBOSE,
+           "[demo log] video behind the master clock, decoder skip level %d\n", level);
+}
+
+/*
+ * a picture that ends before the master clock would only be shown late,
+ * drop it before it costs a conversion. never while the clock is still
+ * from before a seek, or when no more pictures are coming
+ */
+static int frame_is_late(VideoInfo *info, AVFrame *frame, int serial) {
+    double diff = 0;
+    
+    if (!info->opts.framedrop || get_master_sync_type(info) == AV_SYNC_VIDEO_MASTER)
+        return 0;
+    if (serial != info->seek_serial || !packetQueue_nb_packets(info->video_q))
+        return 0;
+    
+    diff = frame_end_time(info, frame) - get_master_clock(info);
+    return diff < 0 && diff > -AV_NOSYNC_THRESHOLD;
+}
+
+static int frame_enqueue(AVFrame *frame, VideoInfo *info, int serial) {
     int rc = 0;
+    int late = 0;
+    int width = 0, height = 0;
     double pts = 0;
+    SwsPool *sws_pool = NULL;
     
     /* get pts */
     pts = frame->best_effort_timestamp;
     pts *= av_q2d(info->v_st->time_base);
     pts = sync_video_clock(info, frame, pts);
     
+    late = frame_is_late(info, frame, serial);
+    update_decoder_skip(info, late);
+    if (late) {
+        info->nb_frames_dropped_early++;
+        av_frame_unref(frame);
+        return 0;
+    }
+    
+    /* previous picture may still be converting, it has to land first */
+    if (info->sws_pool) {
+        swsPool_wait(info->sws_pool);
+    }
+    
     /* waiting if queue is fulling */
     SDL_LockMutex(info->p_mutex);
-    while (info->video_buf_size >= VIDEO_PICTURE_QUEUE_SIZE && !info->quit)
+    while (info->video_buf_size >= info->video_buf_depth &&
+           serial == packetQueue_serial(info->video_q) &&
+           !info->quit)
         SDL_CondWait(info->p_cond, info->p_mutex);
     SDL_UnlockMutex(info->p_mutex);
     
+    /* a seek came in while we waited, nobody wants this picture anymore */
+    if (serial != packetQueue_serial(info->video_q)) {
+        av_frame_unref(frame);
+        return 0;
+    }
+    
     /* get resue buffer */
     FrameInfo *frame_info = info->video_buf[info->video_buf_widx];
     if (!frame_info) {
         frame_info = malloc(sizeof(FrameInfo));
-        AVFrame *r_vframe = sws_frame_alloc(info);
-        frame_info->frame = r_vframe;
+        frame_info->frame = av_frame_alloc();
+        frame_info->direct = 0;
+        frame_info->owner = info;
+        info->video_buf[info->video_buf_widx] = frame_info;
     }
     /* record pts */
     frame_info->pts = pts;
+    frame_info->serial = serial;
     
-    /* rescale frame */
-    sws_scale(info->sws_ctx,
-              (const uint8_t *const *)frame->data,
-              frame->linesize,
-              0,
-              info->v_c->height,
-              frame_info->frame->data,
-              frame_info->frame->linesize);
+    picture_target_size(info, frame, &width, &height);
+    if (frame_is_renderable(frame, width, height)) {
+        /* decoder output is already what the texture wants, keep it by reference */
+        if (!frame_info->direct && frame_info->frame->buf[0]) {
+            picture_buffer_count(info, -1);
+        }
+        av_frame_unref(frame_info->frame);
+        av_frame_move_ref(frame_info->frame, frame);
+        frame_info->direct = 1;
+        frame_publish(info, frame_info);
+    } else {
+        /* slot may still hold a decoder frame, never had a buffer of its own, or one of the old size */
+        int owned = !frame_info->direct && frame_info->frame->buf[0];
+        if (!owned ||
+            frame_info->frame->width != width ||
+            frame_info->frame->height != height) {
+            av_frame_unref(frame_info->frame);
+            rc = sws_frame_get_buffer(info, frame_info->frame, width, height);
+            if (rc < 0) {
+                if (owned) {
+                    picture_buffer_count(info, -1);
+                }
+                av_log(NULL, AV_LOG_ERROR, "failed to allocate picture buffer\n");
+                return rc;
+            }
+            if (!owned) {
+                picture_buffer_count(info, 1);
+            }
+        }
+        frame_info->direct = 0;
+        
+        if (!(sws_pool = get_sws_pool(info))) {
+            av_log(NULL, AV_LOG_ERROR, "failed to create sws worker pool\n");
+            return AVERROR_UNKNOWN;
+        }
+        
+        /* rescale frame in slices, published by frame_converted while we decode on */
+        rc = swsPool_submit(sws_pool,
+                            frame,
+                            frame_info->frame,
+                            info->opts.scaler_flags,
+                            frame_converted,
+                            frame_info);
+        if (rc < 0) {
+            av_log(NULL, AV_LOG_ERROR, "failed to submit frame for conversion\n");
+            return rc;
+        }
+    }
     
     /* frame enqueue */
-    info->video_buf[info->video_buf_widx++] = frame_info;
-    if (info->video_buf_widx >= VIDEO_PICTURE_QUEUE_SIZE)
+    info->video_buf_widx++;
+    if (info->video_buf_widx >= info->video_buf_max)
         info->video_buf_widx = 0;
     
+    return rc;
+}
+
+/*
+ * consumer side of the picture queue: drop what the slot references and
+ * hand memory back if the queue holds more buffers than its current depth
+ */
+static void picture_queue_pop(VideoInfo *info, FrameInfo *frame_info) {
+    int shrunk = 0;
+    
+    if (frame_info->direct) {
+        /* give a referenced decoder frame back as soon as it is uploaded */
+        av_frame_unref(frame_info->frame);
+    }
+    
     SDL_LockMutex(info->p_mutex);
-    info->video_buf_size++;
+    if (!frame_info->direct && frame_info->frame->buf[0] &&
+        info->video_buf_allocated > info->video_buf_depth) {
+        av_frame_unref(frame_info->frame);
+        info->video_buf_allocated--;
+        shrunk = 1;
+    }
+    if (++info->video_buf_ridx >= info->video_buf_max)
+        info->video_buf_ridx = 0;
+    info->video_buf_size--;
+    SDL_CondBroadcast(info->p_cond);
     SDL_UnlockMutex(info->p_mutex);
     
-    return rc;
+    /* the buffer went back to the pool, which would keep it around */
+    if (shrunk) {
+        framePool_trim(&info->picture_pool);
+    }
+    if (info->decode_task) {
+        executor_wake(info->decode_task);
+    }
+}
+
+static int picture_queue_max_for_budget(VideoInfo *info) {
+    int64_t frame_bytes = av_image_get_buffer_size(AV_PIX_FMT_YUV420P,
+                                                   info->v_c->width,
+                                                   info->v_c->height,
+                                                   1);
+    int64_t max = frame_bytes > 0 ? info->opts.picture_queue_budget / frame_bytes : 0;
+    
+    if (max > info->opts.picture_queue_max)
+        max = info->opts.picture_queue_max;
+    return (int)FFMAX(max, VIDEO_PICTURE_QUEUE_MIN);
+}
+
+static int init_picture_queue(VideoInfo *info) {
+    int depth = info->opts.picture_queue_size;
+    
+    info->video_buf_max = picture_queue_max_for_budget(info);
+    if (!info->opts.picture_queue_adaptive) {
+        /* fixed depth, only the budget may cut it */
+        info->video_buf_max = FFMIN(FFMAX(depth, 1), info->video_buf_max);
+    }
+    info->video_buf_depth = av_clip(depth, 1, info->video_buf_max);
+    info->video_buf = calloc(info->video_buf_max, sizeof(FrameInfo *));
+    if (!info->video_buf)
+        return AVERROR(ENOMEM);
+    
+    av_log(NULL, AV_LOG_VERBOSE,
+           "[demo log] picture queue: depth %d, max %d%s\n",
+           info->video_buf_depth,
+           info->video_buf_max,
+           info->opts.picture_queue_adaptive ? ", adaptive" : "");
+    return 0;
+}
+
+/*
+ * size the queue to cover decode spikes: enough pictures to ride out the
+ * mean plus three deviations of per picture decode time. grow at once,
+ * shrink one step after a couple of seconds of calm
+ */
+static void adapt_picture_queue(VideoInfo *info, double produce_time) {
+    AVRational frame_rate = info->v_st->avg_frame_rate;
+    double frame_duration = frame_rate.num && frame_rate.den ? 1.0 / av_q2d(frame_rate) : 40e-3;
+    double diff = produce_time - info->produce_time_avg;
+    int wanted = 0;
+    
+    /* ewma over roughly the last 32 pictures */
+    info->produce_time_avg += diff / 32;
+    info->produce_time_var += (diff * diff - info->produce_time_var) / 32;
+    
+    if (!info->opts.picture_queue_adaptive)
+        return;
+    
+    wanted = 1 + (int)ceil((info->produce_time_avg + 3 * sqrt(info->produce_time_var)) / frame_duration);
+    wanted = av_clip(wanted, VIDEO_PICTURE_QUEUE_MIN, info->video_buf_max);
+    
+    SDL_LockMutex(info->p_mutex);
+    if (wanted > info->video_buf_depth) {
+        info->video_buf_depth = wanted;
+        info->depth_shrink_count = 0;
+    } else if (wanted < info->video_buf_depth) {
+        if (++info->depth_shrink_count * frame_duration > 2.0) {
+            info->video_buf_depth--;
+            info->depth_shrink_count = 0;
+        }
+    } else {
+        info->depth_shrink_count = 0;
+    }
+    SDL_UnlockMutex(info->p_mutex);
+}
+
+/* first packet after a seek, references from before it are useless */
+static void video_decoder_reset(VideoInfo *info, double *skip_until) {
+    avcodec_flush_buffers(info->v_c);
+    /* trick play lands on keyframes near the target, nothing is decoded up to it */
+    *skip_until = info->opts.accurate_seek && !info->stream_speed ? info->seek_target : 0;
+    info->v_c->skip_frame = info->stream_speed ? AVDISCARD_NONKEY :
+                            info->skip_level >= 2 ? AVDISCARD_NONREF : AVDISCARD_DEFAULT;
+}
+
+/* dequeue time rides along to the frame, see video_decode stats */
+static int video_send_packet(VideoInfo *info, AVPacket *pkt) {
+    info->v_c->reordered_opaque = av_gettime_relative();
+    if (info->skip_level >= 2) {
+        info->nb_skip_packets++;
+    }
+    return avcodec_send_packet(info->v_c, pkt);
+}
+
+/* bookkeeping for a decoded picture in v_frame, 0 if it is not meant for the picture queue */
+static int video_frame_decoded(VideoInfo *info, double *skip_until, int64_t *busy_time) {
+    info->nb_video_frames++;
+    if (info->skip_level >= 2) {
+        info->nb_skip_frames++;
+    }
+    if (info->v_frame->reordered_opaque > 0) {
+        latencyHistogram_record(&info->stats.video_decode,
+                                av_gettime_relative() - info->v_frame->reordered_opaque);
+    }
+    adapt_picture_queue(info, *busy_time / 1000000.0);
+    *busy_time = 0;
+    if (*skip_until) {
+        /* accurate seek: decoded only to get from the keyframe to the target */
+        if (frame_end_time(info, info->v_frame) <= *skip_until) {
+            av_frame_unref(info->v_frame);
+            return 0;
+        }
+        *skip_until = 0;
+    }
+    if (info->opts.benchmark == BENCHMARK_DECODE) {
+        av_frame_unref(info->v_frame);
+        return 0;
+    }
+    return 1;
+}
+
+/* decoder is gone: cpu is the time it used, rc < 0 if it broke */
+static void video_decode_done(VideoInfo *info, int rc, double cpu) {
+    /* last converted picture has to be in the queue before we report eof */
+    if (info->sws_pool) {
+        swsPool_wait(info->sws_pool);
+    }
+    SDL_LockMutex(info->p_mutex);
+    info->video_cpu = cpu;
+    info->video_eof = 1;
+    SDL_CondBroadcast(info->p_cond);
+    SDL_UnlockMutex(info->p_mutex);
+    
+    if (rc < 0) {
+        SDL_LockMutex(info->w_mutex);
+        
+        info->err_code = rc;
+        av_log(NULL, AV_LOG_ERROR, "failed to decode frame, codec is broken\n");
+        
+        SDL_UnlockMutex(info->w_mutex);
+    }
 }
 
 static int decode_thread(void *data) {
@@ -295,17 +1047,39 @@ static int decode_thread(void *data) {
     pkt.data = NULL;
     pkt.size = 0;
     
-    int got_pic = 0;
+    int eof = 0, drained = 0;
+    int serial = 0, pkt_serial = 0;
+    double skip_until = 0;
+    int64_t busy_start = 0, busy_time = 0;
     while (1) {
         if (info->quit) break;
         
-        rc = packetQueue_dequeue(info->video_q, &pkt, 1, info);
-        if (rc < 0) break;
-        
-        rc = avcodec_send_packet(info->v_c, &pkt);
+        rc = packetQueue_dequeue(info->video_q, &pkt, 1, info, &pkt_serial);
+        /* only decoder time counts towards picture production, not waits on the queues */
+        busy_start = av_gettime_relative();
+        if (rc == 0 && pkt_serial != serial) {
+            serial = pkt_serial;
+            drained = 0;
+            video_decoder_reset(info, &skip_until);
+        }
+        if (rc == AVERROR_EOF && drained) {
+            /* eof again before any packet of the new serial, nothing to flush twice */
+            if (packetQueue_wait_serial(info->video_q, pkt_serial, info) < 0) break;
+            continue;
+        }
+        if (rc == AVERROR_EOF) {
+            /* no more input, flush the frames the decoder still holds */
+            eof = 1;
+            rc = avcodec_send_packet(info->v_c, NULL);
+        } else if (rc < 0) {
+            break;
+        } else {
+            rc = video_send_packet(info, &pkt);
+        }
         
         while (rc == 0) {
             rc = avcodec_receive_frame(info->v_c, info->v_frame);
+            busy_time += av_gettime_relative() - busy_start;
             if (rc == AVERROR(EAGAIN) || rc == AVERROR_EOF) {
                 rc = 0;
                 break;
@@ -313,25 +1087,110 @@ static int decode_thread(void *data) {
                 rc = -1;
                 break;
             } else {
-                rc = frame_enqueue(info->v_frame, info);
+                if (video_frame_decoded(info, &skip_until, &busy_time)) {
+                    rc = frame_enqueue(info->v_frame, info, serial);
+                }
+                busy_start = av_gettime_relative();
             }
         }
         
         av_packet_unref(&pkt);
         
         if (rc < 0) break;
+        if (eof) {
+            if (info->headless) break;
+            /* drained, stay around in case the user seeks back */
+            drained = 1;
+            if (packetQueue_wait_serial(info->video_q, serial, info) < 0) break;
+            eof = 0;
+        }
     }
     
-    if (rc < 0) {
-        SDL_LockMutex(info->w_mutex);
+    video_decode_done(info, rc, thread_cpu_time());
+    return rc;
+}
+
+/*
+ * decode_thread as an executor task. a step runs while there is a packet
+ * to feed and room in the picture queue, a decoded picture that finds the
+ * queue full is kept until picture_queue_pop wakes us
+ */
+static int video_decode_step(void *opaque) {
+    VideoInfo *info = (VideoInfo *)opaque;
+    int rc = 0;
+    int full = 0;
+    int pkt_serial = 0;
+    int64_t busy_start = 0;
+    
+    for (int i = 0; i < DECODE_STEP_PICTURES && !info->quit; ) {
+        if (info->video_frame_pending) {
+            if (info->video_dec_serial == packetQueue_serial(info->video_q)) {
+                SDL_LockMutex(info->p_mutex);
+                full = info->video_buf_size >= info->video_buf_depth;
+                SDL_UnlockMutex(info->p_mutex);
+                if (full)
+                    return TASK_WAIT;
+            }
+            /* a stale picture is dropped in there */
+            info->video_frame_pending = 0;
+            if ((rc = frame_enqueue(info->v_frame, info, info->video_dec_serial)) < 0)
+                goto __done;
+            i++;
+            continue;
+        }
         
-        info->err_code = rc;
-        av_log(NULL, AV_LOG_ERROR, "failed to decode frame, codec is broken\n");
+        if (!info->video_dec_eof) {
+            busy_start = av_gettime_relative();
+            rc = avcodec_receive_frame(info->v_c, info->v_frame);
+            info->video_busy_time += av_gettime_relative() - busy_start;
+            if (rc == 0) {
+                info->video_frame_pending = video_frame_decoded(info, &info->video_skip_until, &info->video_busy_time);
+                continue;
+            } else if (rc == AVERROR_EOF) {
+                info->video_dec_eof = 1;
+            } else if (rc != AVERROR(EAGAIN)) {
+                goto __done;
+            }
+        }
+        if (info->video_dec_eof) {
+            if (info->headless) {
+                rc = 0;
+                goto __done;
+            }
+            /* drained, a flush moves the queue on and wakes us */
+            if (packetQueue_serial(info->video_q) == info->video_dec_serial)
+                return TASK_WAIT;
+        }
         
-        SDL_UnlockMutex(info->w_mutex);
+        /* decoder wants input */
+        rc = packetQueue_dequeue(info->video_q, info->video_pkt, 0, info, &pkt_serial);
+        if (rc == AVERROR(EAGAIN))
+            return TASK_WAIT;
+        busy_start = av_gettime_relative();
+        if (rc == 0 && pkt_serial != info->video_dec_serial) {
+            info->video_dec_serial = pkt_serial;
+            info->video_dec_eof = 0;
+            video_decoder_reset(info, &info->video_skip_until);
+        }
+        if (rc == AVERROR_EOF) {
+            /* eof again before any packet of the new serial, nothing to flush twice */
+            if (info->video_dec_eof)
+                return TASK_WAIT;
+            rc = avcodec_send_packet(info->v_c, NULL);
+        } else if (rc == 0) {
+            rc = video_send_packet(info, info->video_pkt);
+        }
+        info->video_busy_time += av_gettime_relative() - busy_start;
+        av_packet_unref(info->video_pkt);
+        if (rc < 0)
+            goto __done;
     }
+    if (!info->quit)
+        return TASK_AGAIN;
     
-    return rc;
+__done:
+    video_decode_done(info, rc, info->decode_task->cpu_time);
+    return TASK_DONE;
 }
 
 static int init_video_component(VideoInfo *info) {
@@ -344,22 +1203,28 @@ static int init_video_component(VideoInfo *info) {
     info->v_st = info->fmt_ctx->streams[info->video_stream_idx];
     CHECK_ERROR(((rc = open_codec(&v_codec,
                                   &info->v_c,
-                                  info->v_st)) < 0),
+                                  info->v_st,
+                                  &info->opts)) < 0),
                 "open video codec failed",
                 0,
                 __exit)
     
     AVCodecContext *v_c = info->v_c;
-    CHECK_ERROR(!(info->sws_ctx = sws_getContext(v_c->width,
-                                                 v_c->height,
-                                                 v_c->pix_fmt,
-                                                 v_c->width,
-                                                 v_c->height,
-                                                 AV_PIX_FMT_YUV420P,
-                                                 SWS_BILINEAR,
-                                                 NULL, NULL, NULL)),
-                "failed to create swscontext",
-                AVERROR_UNKNOWN, __exit)
+    
+    /* a frame threaded decoder holds back thread_count - 1 frames before the first output */
+    if (v_c->active_thread_type & FF_THREAD_FRAME) {
+        AVRational frame_rate = info->v_st->avg_frame_rate;
+        double frame_duration = frame_rate.num && frame_rate.den ? 1.0 / av_q2d(frame_rate) : 40e-3;
+        info->video_decode_latency = (v_c->thread_count - 1) * frame_duration;
+    }
+    /* picture buffers for conversions, see frame_enqueue */
+    info->picture_pool.hugepages = info->opts.hugepages;
+    /* 4:2:0 streams are rendered by reference, the sws pool only starts for real conversions */
+    if (!yuvUpload_supported(v_c->pix_fmt)) {
+        CHECK_ERROR(!get_sws_pool(info),
+                    "failed to create sws worker pool",
+                    AVERROR_UNKNOWN, __exit)
+    }
     
     //!!
     CHECK_ERROR(!(v_frame = av_frame_alloc()),
@@ -368,35 +1233,262 @@ static int init_video_component(VideoInfo *info) {
                 __exit)
     info->v_frame = v_frame;
     
-    info->decode_t = SDL_CreateThread(decode_thread, "decode_thread", info);
+    CHECK_ERROR(((rc = init_picture_queue(info)) < 0),
+                "failed to allocate picture queue",
+                0,
+                __exit)
+    
+    /* with shared workers the decoder is a task, woken by the video queue and the picture queue */
+    if (info->executor) {
+        CHECK_ERROR(!(info->video_pkt = av_packet_alloc()),
+                    "failed to allocate video packet",
+                    AVERROR(ENOMEM),
+                    __exit)
+        CHECK_ERROR(!(info->decode_task = executor_task_create(info->executor, video_decode_step, info, "video_decode")),
+                    "failed to create video decode task",
+                    AVERROR(ENOMEM),
+                    __exit)
+        info->video_q->consumer_task = info->decode_task;
+        executor_wake(info->decode_task);
+    } else {
+        info->decode_t = SDL_CreateThread(decode_thread, "decode_thread", info);
+    }
     
     //notified to init SDL video component
-    SDL_Event event;
-    event.type = USER_EVENT_VCODEC_READY;
-    SDL_PushEvent(&event);
+    if (!info->headless) {
+        SDL_Event event;
+        event.type = USER_EVENT_VCODEC_READY;
+        event.user.data1 = info;
+        SDL_PushEvent(&event);
+    }
     
 __exit:
     return rc;
 }
 
-static int demux_thread(void *data) {
+/*
+ * demux side of a seek: land on the closest keyframe before the target,
+ * then let the decoders know where the accurate target is
+ */
+static void do_seek(VideoInfo *info) {
     int rc = 0;
-    VideoInfo *info = (VideoInfo *)data;
-    AVPacket pkt;
+    int64_t target = 0;
+    int64_t seek_ts = 0;
+    int stream_idx = -1;
+    int byte_seek = 0;
+    const KeyframeEntry *keyframe = NULL;
+    double speed = 0.0;
     
-    SDL_Event event;
-    
-    char *in_filename = info->in_filename;
-    
-    CHECK_ERROR((rc = avformat_open_input(&info->fmt_ctx,
-                                          in_filename,
-                                          NULL, NULL)),
-                "failed to open input format",
-                0, __exit)
+    SDL_LockMutex(info->w_mutex);
+    target = info->seek_pos;
+    speed = info->seek_speed;
+    info->seek_req = 0;
+    SDL_UnlockMutex(info->w_mutex);
     
-    CHECK_ERROR(((rc = avformat_find_stream_info(info->fmt_ctx, NULL)) < 0),
-                "failed to find stream info for input filed",
+    seek_ts = target;
+    if (info->has_video) {
+        keyframe = keyframeIndex_lookup(&info->keyframes,
+                                        av_rescale_q(target, AV_TIME_BASE_Q, info->v_st->time_base));
+    }
+    if (keyframe) {
+        /* a keyframe we saw while demuxing has an exact byte offset, use it where the format allows */
+        byte_seek = !info->keyframes.complete && keyframe->pos >= 0 &&
+                    !(info->fmt_ctx->iformat->flags & AVFMT_NO_BYTE_SEEK);
+        if (byte_seek) {
+            rc = avformat_seek_file(info->fmt_ctx, -1, INT64_MIN, keyframe->pos, keyframe->pos, AVSEEK_FLAG_BYTE);
+        } else {
+            stream_idx = info->video_stream_idx;
+            seek_ts = keyframe->pts;
+            rc = avformat_seek_file(info->fmt_ctx, stream_idx, INT64_MIN, seek_ts, seek_ts, 0);
+        }
+    } else {
+        /* unknown territory, max_ts == target still lands on or before it */
+        rc = avformat_seek_file(info->fmt_ctx, -1, INT64_MIN, seek_ts, seek_ts, 0);
+    }
+    if (rc < 0) {
+        av_log(NULL, AV_LOG_ERROR, "[demo log] seek to %.3f failed: %s\n",
+               target / (double)AV_TIME_BASE, av_err2str(rc));
+    }
+    av_log(NULL, AV_LOG_VERBOSE,
+           "[demo log] seek to %.3f via %s\n",
+           target / (double)AV_TIME_BASE,
+           !keyframe ? "demuxer" : byte_seek ? "keyframe offset" : "keyframe pts");
+    
+    keyframeIndex_break(&info->keyframes);
+    /* read by the decoders once they meet the first packet of the new serial */
+    info->seek_target = target / (double)AV_TIME_BASE;
+    info->stream_speed = speed;
+    /* trick play drops audio, an empty audio queue must not let video overfill */
+    packetQueue_set_idle(info->audio_q, speed != 0);
+    info->trick_last = info->trick_next = AV_NOPTS_VALUE;
+    info->trick_seek = info->trick_start = 0;
+    info->demux_eof = 0;
+}
+
+/*
+ * trick play, demux side: only video keyframes go out, audio is dropped
+ * before it costs a decode. after each keyframe the input moves on by
+ * stream_speed / TRICK_PLAY_FPS seconds, either way, so the decoder gets
+ * about the same number of pictures a second whatever the speed
+ */
+static PacketQueue *trick_play_packet(VideoInfo *info, AVPacket *pkt) {
+    if (pkt->stream_index != info->video_stream_idx ||
+        !(pkt->flags & AV_PKT_FLAG_KEY) ||
+        pkt->pts == AV_NOPTS_VALUE)
+        return NULL;
+    
+    if (info->trick_last != AV_NOPTS_VALUE) {
+        /* read on from the last one, not far enough yet */
+        if (info->stream_speed > 0 && pkt->pts < info->trick_next)
+            return NULL;
+        /* the seek back did not get before the last one, that was the first keyframe */
+        if (info->stream_speed < 0 && pkt->pts >= info->trick_last) {
+            info->trick_start = 1;
+            return NULL;
+        }
+    }
+    info->trick_last = pkt->pts;
+    info->trick_next = pkt->pts + av_rescale_q((int64_t)(info->stream_speed * AV_TIME_BASE / TRICK_PLAY_FPS),
+                                               AV_TIME_BASE_Q,
+                                               info->v_st->time_base);
+    info->trick_seek = 1;
+    return info->video_q;
+}
+
+/* before each read while trick playing: jump to trick_next, AVERROR_EOF once rewound to the start */
+static int trick_play_seek(VideoInfo *info) {
+    int rc = 0;
+    int64_t target = info->trick_next;
+    const KeyframeEntry *keyframe = NULL;
+    
+    if (info->trick_start)
+        return AVERROR_EOF;
+    if (!info->trick_seek)
+        return 0;
+    info->trick_seek = 0;
+    
+    keyframe = keyframeIndex_lookup(&info->keyframes, target);
+    if (info->stream_speed > 0) {
+        /* no keyframe known between here and the target, reading on gets there as well */
+        if (!keyframe || keyframe->pts <= info->trick_last)
+            return 0;
+        target = keyframe->pts;
+        rc = avformat_seek_file(info->fmt_ctx, info->video_stream_idx, info->trick_last + 1, target, target, 0);
+    } else {
+        if (keyframe)
+            target = keyframe->pts;
+        rc = avformat_seek_file(info->fmt_ctx, info->video_stream_idx, INT64_MIN, target, target, 0);
+    }
+    /* only costs reading on, trick_play_packet still picks the keyframes */
+    if (rc < 0) {
+        av_log(NULL, AV_LOG_VERBOSE, "[demo log] trick play seek failed: %s\n", av_err2str(rc));
+    }
+    keyframeIndex_break(&info->keyframes);
+    return 0;
+}
+
+/* decoders open side by side, this one takes the audio */
+static int audio_open_thread(void *data) {
+    return init_audio_component((VideoInfo *)data);
+}
+
+/*
+ * fast start: the header alone is enough when no stream can show up later
+ * and every stream knows its codec and dimensions. pixel and sample format
+ * often come only with the first frame (mp4, h264), nothing needs them earlier
+ */
+static int header_describes_streams(AVFormatContext *fmt_ctx) {
+    if (!fmt_ctx->nb_streams || (fmt_ctx->ctx_flags & AVFMTCTX_NOHEADER))
+        return 0;
+    for (int i = 0; i < fmt_ctx->nb_streams; i++) {
+        AVCodecParameters *par = fmt_ctx->streams[i]->codecpar;
+        if (par->codec_type == AVMEDIA_TYPE_VIDEO &&
+            (par->codec_id == AV_CODEC_ID_NONE || par->width <= 0 || par->height <= 0))
+            return 0;
+        if (par->codec_type == AVMEDIA_TYPE_AUDIO &&
+            (par->codec_id == AV_CODEC_ID_NONE || par->sample_rate <= 0 || par->channels <= 0))
+            return 0;
+    }
+    return 1;
+}
+
+/* the streams being played, a recording that fails to start leaves playback alone */
+static void open_recorder(VideoInfo *info) {
+    int streams[2];
+    int nb_streams = 0;
+    
+    if (info->has_video)
+        streams[nb_streams++] = info->video_stream_idx;
+    if (info->has_audio)
+        streams[nb_streams++] = info->audio_stream_idx;
+    if (!(info->recorder = malloc(sizeof(Recorder))))
+        return;
+    if (recorder_open(info->recorder, info->opts.record_filename, info->fmt_ctx, streams, nb_streams) < 0) {
+        recorder_close(info->recorder);
+        free(info->recorder);
+        info->recorder = NULL;
+        return;
+    }
+    info->recorder->lag = &info->stats.record;
+}
+
+/* input, streams and decoders; fills in everything the read loop needs */
+static int demux_open(VideoInfo *info) {
+    int rc = 0;
+    char *in_filename = info->in_filename;
+    AVDictionary *format_opts = NULL;
+    SDL_Thread *audio_open_t = NULL;
+    int audio_rc = 0;
+    int64_t open_time = 0, probe_time = 0;
+    
+    if (info->opts.probesize > 0)
+        av_dict_set_int(&format_opts, "probesize", info->opts.probesize, 0);
+    else if (info->opts.fast_start)
+        av_dict_set_int(&format_opts, "probesize", FAST_START_PROBESIZE, 0);
+    if (info->opts.analyzeduration > 0)
+        av_dict_set_int(&format_opts, "analyzeduration", info->opts.analyzeduration, 0);
+    else if (info->opts.fast_start)
+        av_dict_set_int(&format_opts, "analyzeduration", FAST_START_ANALYZEDURATION, 0);
+    
+    /*
+     * demuxer reads from memory, a reader thread keeps the ring filled from disk
+     * or network. only byte streams avio has a protocol for, rtsp or a capture
+     * device is opened by its demuxer the plain way
+     */
+    if (info->opts.read_ahead_size > 0 && !avio_find_protocol_name(in_filename)) {
+        av_log(NULL, AV_LOG_VERBOSE, "[demo log] read-ahead: no byte stream protocol for %s, opened as is\n", in_filename);
+    } else if (info->opts.read_ahead_size > 0) {
+        CHECK_ERROR(!(info->read_ahead = malloc(sizeof(ReadAhead))),
+                    "failed to allocate read-ahead",
+                    AVERROR(ENOMEM),
+                    __exit)
+        rc = readAhead_open(info->read_ahead, in_filename, (size_t)info->opts.read_ahead_size);
+        info->read_ahead->stall = &info->stats.io_stall;
+        CHECK_ERROR(rc < 0,
+                    "failed to open read-ahead input",
+                    0, __exit)
+        CHECK_ERROR(!(info->fmt_ctx = avformat_alloc_context()),
+                    "failed to allocate format context",
+                    AVERROR(ENOMEM),
+                    __exit)
+        info->fmt_ctx->pb = info->read_ahead->pb;
+    }
+    
+    rc = avformat_open_input(&info->fmt_ctx, in_filename, NULL, &format_opts);
+    CHECK_ERROR(rc,
+                "failed to open input format",
                 0, __exit)
+    open_time = av_gettime_relative();
+    
+    /* probing decodes packets of every stream, skip it when the header says it all */
+    if (info->opts.fast_start && header_describes_streams(info->fmt_ctx)) {
+        av_log(NULL, AV_LOG_VERBOSE, "[demo log] fast start: stream info taken from the header\n");
+    } else {
+        CHECK_ERROR(((rc = avformat_find_stream_info(info->fmt_ctx, NULL)) < 0),
+                    "failed to find stream info for input filed",
+                    0, __exit)
+    }
+    probe_time = av_gettime_relative();
     
     av_dump_format(info->fmt_ctx, 0, NULL, 0);
         
@@ -417,76 +1509,294 @@ static int demux_thread(void *data) {
                 AVERROR_UNKNOWN,
                 __exit);
     
+    /* queues measure their buffered duration in stream time base */
+    if (info->has_video)
+        info->video_q->time_base = info->fmt_ctx->streams[info->video_stream_idx]->time_base;
+    if (info->has_audio)
+        info->audio_q->time_base = info->fmt_ctx->streams[info->audio_stream_idx]->time_base;
+    /* a cover picture is one packet, it must not hold the audio queue unbounded */
+    if (info->has_audio && info->has_video &&
+        !(info->fmt_ctx->streams[info->video_stream_idx]->disposition & AV_DISPOSITION_ATTACHED_PIC))
+        packetQueue_set_peer(info->video_q, info->audio_q);
+    
+    //audio codec and device open on a helper thread while the video codec opens here
+    if (info->has_audio && !(audio_open_t = SDL_CreateThread(audio_open_thread, "audio_open", info))) {
+        audio_rc = init_audio_component(info);
+    }
+    
     //if has video stream
-    CHECK_ERROR(((rc = init_video_component(info)) < 0),
+    rc = init_video_component(info);
+    if (audio_open_t) {
+        SDL_WaitThread(audio_open_t, &audio_rc);
+    }
+    CHECK_ERROR(rc < 0,
                 "failed to init video component",
                 0,
                 __exit)
     
     //if has audio stream
-    CHECK_ERROR(((rc = init_audio_component(info)) < 0),
-                "failed to init video component",
+    CHECK_ERROR(((rc = audio_rc) < 0),
+                "failed to init audio component",
                 0,
                 __exit)
     
-    av_init_packet(&pkt);
-    pkt.data = NULL;
-    pkt.size = 0;
+    av_log(NULL, AV_LOG_VERBOSE,
+           "[demo log] startup: input open %.1f ms, streams probed %.1f ms, decoders open %.1f ms\n",
+           (open_time - info->startup_time) / 1000.0,
+           (probe_time - info->startup_time) / 1000.0,
+           (av_gettime_relative() - info->startup_time) / 1000.0);
     
-    while ((rc = av_read_frame(info->fmt_ctx, &pkt)) == 0) {
-        if (info->quit) {
-            SDL_CondSignal(info->audio_q->cond);
-            SDL_CondSignal(info->video_q->cond);
-            break;
-        };
-        
-//        if (info->audio_q->size > MAX_AUDIOQ_SIZE || info->video_q->size > MAX_VIDEOQ_SIZE) {
-////            SDL_Delay(10);
-//            continue;
-//        }
-        
-        if (pkt.stream_index == info->audio_stream_idx) {
-            packetQueue_enqueue(info->audio_q, &pkt);
-        } else if (pkt.stream_index == info->video_stream_idx) {
-            packetQueue_enqueue(info->video_q, &pkt);
-        }
-        av_packet_unref(&pkt);
+    if (info->has_video) {
+        keyframeIndex_load(&info->keyframes, info->v_st);
     }
-    
-    rc = 0;
-    while (!info->quit) {
-        SDL_Delay(200);
+    if (info->opts.record_filename) {
+        open_recorder(info);
     }
     
 __exit:
+    av_dict_free(&format_opts);
+    return rc;
+}
+
+/* bookkeeping for a packet just read, returns the queue it belongs in or NULL */
+static PacketQueue *demux_packet_queue(VideoInfo *info, AVPacket *pkt, int serial, int64_t read_start) {
+    latencyHistogram_record(&info->stats.demux, av_gettime_relative() - read_start);
+    
+    info->nb_packets_read++;
+    info->bytes_read += pkt->size;
+    
+    if (pkt->stream_index == info->video_stream_idx &&
+        (pkt->flags & AV_PKT_FLAG_KEY) &&
+        pkt->pts != AV_NOPTS_VALUE) {
+        keyframeIndex_add(&info->keyframes, pkt->pts, pkt->pos);
+    }
+    
+    /* what trick play reads is not what gets played */
+    if (info->recorder && !info->stream_speed)
+        recorder_send(info->recorder, pkt, serial);
+    if (info->stream_speed)
+        return trick_play_packet(info, pkt);
+    if (pkt->stream_index == info->audio_stream_idx)
+        return info->audio_q;
+    if (pkt->stream_index == info->video_stream_idx)
+        return info->video_q;
+    return NULL;
+}
+
+/* let the decoders drain and run dry instead of waiting forever, serial is what the demuxer read for */
+static void demux_reached_eof(VideoInfo *info, int serial, double cpu) {
+    packetQueue_finish(info->audio_q, serial);
+    packetQueue_finish(info->video_q, serial);
+    
+    SDL_LockMutex(info->p_mutex);
+    info->demux_cpu = cpu;
+    info->demux_eof = 1;
+    SDL_CondBroadcast(info->p_cond);
+    SDL_UnlockMutex(info->p_mutex);
+}
+
+/* the event loop closes the player once the demuxer gave up */
+static void demux_done(VideoInfo *info, int rc) {
+    SDL_Event event;
+    
+    SDL_LockMutex(info->p_mutex);
+    info->demux_eof = 1;
+    SDL_CondBroadcast(info->p_cond);
+    SDL_UnlockMutex(info->p_mutex);
     
     SDL_LockMutex(info->w_mutex);
     
     info->err_code = rc;
-    event.type = SDL_QUIT;
+    event.type = USER_EVENT_PLAYER_DONE;
+    event.user.data1 = info;
     SDL_PushEvent(&event);
     
     SDL_UnlockMutex(info->w_mutex);
+}
+
+/*
+ * the read loop as an executor task: a few packets per step, a packet whose
+ * queue is full is kept until the consumer drained it to the low watermark.
+ * at the end of the input it idles until stream_seek wakes it
+ */
+static int demux_step(void *opaque) {
+    VideoInfo *info = (VideoInfo *)opaque;
+    int rc = 0;
+    int serial = 0, seek_req = 0;
+    int64_t read_start = 0;
+    PacketQueue *q = NULL;
+    
+    for (int i = 0; i < DEMUX_STEP_PACKETS && !info->quit; i++) {
+        /* read in an earlier step, stale by now if a seek came in */
+        if (info->demux_pkt_q) {
+            rc = packetQueue_try_enqueue(info->demux_pkt_q, info->demux_pkt, info->demux_pkt_serial);
+            if (rc == AVERROR(EAGAIN))
+                return TASK_WAIT;
+            av_packet_unref(info->demux_pkt);
+            info->demux_pkt_q = NULL;
+        }
+        
+        /* sampled together with the request, see stream_seek */
+        SDL_LockMutex(info->w_mutex);
+        serial = info->seek_serial;
+        seek_req = info->seek_req;
+        SDL_UnlockMutex(info->w_mutex);
+        if (seek_req) {
+            do_seek(info);
+            continue;
+        }
+        if (info->demux_eof)
+            return TASK_WAIT;
+        
+        read_start = av_gettime_relative();
+        if (trick_play_seek(info) < 0 ||
+            av_read_frame(info->fmt_ctx, info->demux_pkt) < 0) {
+            demux_reached_eof(info, serial, info->demux_task->cpu_time);
+            return TASK_WAIT;
+        }
+        if (!(q = demux_packet_queue(info, info->demux_pkt, serial, read_start))) {
+            av_packet_unref(info->demux_pkt);
+            continue;
+        }
+        rc = packetQueue_try_enqueue(q, info->demux_pkt, serial);
+        if (rc == AVERROR(EAGAIN)) {
+            info->demux_pkt_q = q;
+            info->demux_pkt_serial = serial;
+            return TASK_WAIT;
+        }
+        /* no-op once the queue moved the reference out */
+        av_packet_unref(info->demux_pkt);
+    }
+    if (!info->quit)
+        return TASK_AGAIN;
     
+    packetQueue_abort(info->audio_q);
+    packetQueue_abort(info->video_q);
+    demux_done(info, 0);
+    return TASK_DONE;
+}
+
+static int demux_thread(void *data) {
+    int rc = 0;
+    VideoInfo *info = (VideoInfo *)data;
+    AVPacket pkt;
+    PacketQueue *q = NULL;
+    
+    if ((rc = demux_open(info)) < 0)
+        goto __exit;
+    
+    /* shared workers: this thread only opened the input, reading goes on as a task */
+    if (info->executor) {
+        CHECK_ERROR(!(info->demux_pkt = av_packet_alloc()),
+                    "failed to allocate demux packet",
+                    AVERROR(ENOMEM),
+                    __exit)
+        CHECK_ERROR(!(info->demux_task = executor_task_create(info->executor, demux_step, info, "demux")),
+                    "failed to create demux task",
+                    AVERROR(ENOMEM),
+                    __exit)
+        info->audio_q->producer_task = info->demux_task;
+        info->video_q->producer_task = info->demux_task;
+        executor_wake(info->demux_task);
+        return 0;
+    }
+    
+    av_init_packet(&pkt);
+    pkt.data = NULL;
+    pkt.size = 0;
+    
+    int serial = 0, seek_req = 0;
+    while (!info->quit) {
+        /* sampled together with the request, see stream_seek */
+        SDL_LockMutex(info->w_mutex);
+        serial = info->seek_serial;
+        seek_req = info->seek_req;
+        SDL_UnlockMutex(info->w_mutex);
+        if (seek_req) {
+            do_seek(info);
+            continue;
+        }
+        
+        int64_t read_start = av_gettime_relative();
+        if ((rc = trick_play_seek(info)) >= 0)
+            rc = av_read_frame(info->fmt_ctx, &pkt);
+        if (rc < 0) {
+            demux_reached_eof(info, serial, thread_cpu_time());
+            
+            /* idle at the end until the user seeks back or quits */
+            SDL_LockMutex(info->w_mutex);
+            while (!info->seek_req && !info->quit)
+                SDL_CondWaitTimeout(info->w_cond, info->w_mutex, 200);
+            SDL_UnlockMutex(info->w_mutex);
+            continue;
+        }
+        
+        /* enqueue blocks while the target queue is above its watermark */
+        if ((q = demux_packet_queue(info, &pkt, serial, read_start))) {
+            packetQueue_enqueue(q, &pkt, serial);
+        }
+        /* no-op once the queue moved the reference out */
+        av_packet_unref(&pkt);
+    }
+    packetQueue_abort(info->audio_q);
+    packetQueue_abort(info->video_q);
+    rc = 0;
+    
+__exit:
+    demux_done(info, rc);
     return rc;
 }
 
-static int init_video_SDL_component(VideoInfo *info, int width, int height) {
+/* window and renderer, fast start creates them hidden while the input is still probed */
+static int init_video_window(VideoInfo *info, int width, int height, Uint32 flags) {
     int rc = 0;
-    CHECK_ERROR(!(info->window = SDL_CreateWindow("video player",
+    CHECK_ERROR(!(info->window = SDL_CreateWindow(info->in_filename[0] ? info->in_filename : "video player",
                                                   SDL_WINDOWPOS_UNDEFINED,
                                                   SDL_WINDOWPOS_UNDEFINED,
                                                   width, height,
                                                   SDL_WINDOW_OPENGL |
-                                                  SDL_WINDOW_RESIZABLE)),
+                                                  SDL_WINDOW_RESIZABLE |
+                                                  flags)),
                 "failed to create SDL window",
                 AVERROR_UNKNOWN,
                 __exit)
     
-    CHECK_ERROR(!(info->renderer = SDL_CreateRenderer(info->window, -1, 0)),
+    CHECK_ERROR(!(info->renderer = SDL_CreateRenderer(info->window, -1,
+                                                      info->opts.software_renderer ?
+                                                      SDL_RENDERER_SOFTWARE : 0)),
                 "failed to create SDL renderer",
                 AVERROR_UNKNOWN,
                 __exit)
+    
+__exit:
+    return rc;
+}
+
+/* main thread, pictures decoded from now on are converted for the new drawable */
+static void update_output_size(VideoInfo *info) {
+    int width = 0, height = 0;
+    
+    if (!info->renderer || SDL_GetRendererOutputSize(info->renderer, &width, &height) < 0)
+        return;
+    if (width == atomic_load(&info->output_width) &&
+        height == atomic_load(&info->output_height))
+        return;
+    atomic_store(&info->output_width, width);
+    atomic_store(&info->output_height, height);
+    av_log(NULL, AV_LOG_VERBOSE, "[demo log] drawable %dx%d\n", width, height);
+}
+
+static int init_video_SDL_component(VideoInfo *info, int width, int height) {
+    int rc = 0;
+    if (!info->window) {
+        CHECK_ERROR(((rc = init_video_window(info, width, height, 0)) < 0),
+                    "failed to init SDL window",
+                    0, __exit)
+    } else {
+        SDL_SetWindowSize(info->window, width, height);
+        SDL_ShowWindow(info->window);
+    }
+    update_output_size(info);
 
     CHECK_ERROR(!(info->texture = SDL_CreateTexture(info->renderer,
                                                     SDL_PIXELFORMAT_IYUV,
@@ -496,37 +1806,67 @@ static int init_video_SDL_component(VideoInfo *info, int width, int height) {
                 AVERROR_UNKNOWN,
                 __exit)
     
+    yuvUpload_init();
+    av_log(NULL, AV_LOG_VERBOSE, "[demo log] texture upload: %s row kernels\n", yuvUpload_isa());
+    
 __exit:
     return rc;
 }
 
-static Uint32 sdl_refresh_timer_cb(Uint32 interval, void *opaque) {
-  SDL_Event event;
-  event.type = USER_REFRESH_FRAME;
-  event.user.data1 = opaque;
-  SDL_PushEvent(&event);
-  return 0; /* 0 means stop timer */
-}
-
-static void schedule_refresh(VideoInfo *info, int delay) {
-    SDL_AddTimer(delay, sdl_refresh_timer_cb, info);
-}
-
 static void render_frame(VideoInfo *info, AVFrame *frame) {
-    SDL_Rect rect;
-    rect.x = 0;
-    rect.y = 0;
-    rect.w = info->v_c->width;
-    rect.h = info->v_c->height;
-    
-    //renderer frame
-    SDL_UpdateYUVTexture(info->texture, &rect,
-                         frame->data[0],
-                         frame->linesize[0],
-                         frame->data[1],
-                         frame->linesize[1],
-                         frame->data[2],
-                         frame->linesize[2]);
+    void *pixels = NULL;
+    int pitch = 0;
+    int tex_w = 0, tex_h = 0;
+    int uploaded = 0;
+    SDL_Texture *texture = NULL;
+    
+    /* the stream changed resolution midway, the window keeps its size and scales */
+    SDL_QueryTexture(info->texture, NULL, NULL, &tex_w, &tex_h);
+    if (tex_w != frame->width || tex_h != frame->height) {
+        if (!(texture = SDL_CreateTexture(info->renderer,
+                                          SDL_PIXELFORMAT_IYUV,
+                                          SDL_TEXTUREACCESS_STREAMING,
+                                          frame->width, frame->height))) {
+            av_log(NULL, AV_LOG_ERROR, "failed to resize SDL texture: %s\n", SDL_GetError());
+            return;
+        }
+        SDL_DestroyTexture(info->texture);
+        info->texture = texture;
+        av_log(NULL, AV_LOG_VERBOSE, "[demo log] picture size %dx%d -> %dx%d\n",
+               tex_w, tex_h, frame->width, frame->height);
+    }
+    
+    /* write straight into texture memory instead of letting SDL copy a staged frame */
+    if (SDL_LockTexture(info->texture, NULL, &pixels, &pitch) == 0) {
+        yuvUpload_frame(frame, pixels, pitch);
+        SDL_UnlockTexture(info->texture);
+        uploaded = 1;
+    } else if (frame->format == AV_PIX_FMT_YUV420P || frame->format == AV_PIX_FMT_YUVJ420P) {
+        SDL_Rect rect;
+        rect.x = 0;
+        rect.y = 0;
+        rect.w = frame->width;
+        rect.h = frame->height;
+        
+        //renderer frame
+        SDL_UpdateYUVTexture(info->texture, &rect,
+                             frame->data[0],
+                             frame->linesize[0],
+                             frame->data[1],
+                             frame->linesize[1],
+                             frame->data[2],
+                             frame->linesize[2]);
+        uploaded = 1;
+    } else {
+        av_log(NULL, AV_LOG_ERROR, "failed to lock texture: %s\n", SDL_GetError());
+    }
+    if (uploaded) {
+        int chroma_w = AV_CEIL_RSHIFT(frame->width, 1);
+        int chroma_h = AV_CEIL_RSHIFT(frame->height, 1);
+        info->bytes_uploaded += (int64_t)frame->width * frame->height +
+                                2 * (int64_t)chroma_w * chroma_h;
+        info->nb_uploads++;
+    }
     
     SDL_RenderClear(info->renderer);
     SDL_RenderCopy(info->renderer, info->texture, NULL, NULL);
@@ -534,116 +1874,531 @@ static void render_frame(VideoInfo *info, AVFrame *frame) {
     
 }
 
-static double get_audio_cur_time(VideoInfo *info) {
-    double cur_audio_time = info->audio_clock;
-    size_t remain_buf_size = info->audio_end - info->audio_pos;
-    if (remain_buf_size) {
-        cur_audio_time -= (double)remain_buf_size / (double)info->audio_data_size_ps;
+static void start_audio(VideoInfo *info) {
+    SDL_LockMutex(info->w_mutex);
+    if (!info->audio_started) {
+        info->audio_started = 1;
+        /* trick play keeps it paused, see stream_set_speed */
+        if (info->audio_opened && !info->trick_speed)
+            SDL_PauseAudioDevice(info->audio_dev, 0);
     }
-    return cur_audio_time;
+    SDL_UnlockMutex(info->w_mutex);
 }
 
-static void refresh_frame(void *userdata) {
-    VideoInfo *info = (VideoInfo *)userdata;
-    double delay, audio_clock, rel_diff, threshold_delay, actual_delay = 0.0;
+/*
+ * show the head picture if it is due and work out when the next one is,
+ * returns the absolute wake up time on the av_gettime_relative clock
+ */
+static int64_t refresh_frame(VideoInfo *info) {
+    double delay, master_clock, rel_diff, threshold_delay = 0.0;
+    int64_t now = av_gettime_relative();
     
     if (info->quit) {
         SDL_CondSignal(info->p_cond);
-        return;
+        return PRESENT_NO_DEADLINE;
     }
     
-    if (info->has_video) {
-        if (!info->video_buf_size) {
-            schedule_refresh(info, 1);
-        } else {
-            
-            FrameInfo *frame_info = info->video_buf[info->video_buf_ridx++];
-            AVFrame *frame = frame_info->frame;
-            
-            double pts = frame_info->pts;
-            
-            delay = pts - info->last_frame_pts;
-            if (delay <= 0 || delay > 1.0) {
-                /* incorrect delay */
-                delay = info->last_frame_delay;
-            }
-            
-            info->last_frame_pts = pts;
-            info->last_frame_delay = delay;
-            
-            audio_clock = get_audio_cur_time(info);
-            /* get real diff, see how good effect last predict is */
-            rel_diff = pts - audio_clock;
-            
-            threshold_delay = delay > AV_SYNC_THRESHOLD ? delay : AV_SYNC_THRESHOLD;
-            
-            if (rel_diff <= -threshold_delay) {
-                delay = 0;
-            } else if (rel_diff >= threshold_delay) {
-                delay = 2 * delay;
+    if (!info->first_audio_reported && atomic_load(&info->first_audio_time)) {
+        info->first_audio_reported = 1;
+        av_log(NULL, AV_LOG_INFO,
+               "[demo log] time to first audio: %.1f ms\n",
+               (atomic_load(&info->first_audio_time) - info->startup_time) / 1000.0);
+    }
+    
+    /* external clock runs free, it only snaps back to the streams after a seek or a big jump */
+    if (!info->has_video && info->has_audio) {
+        syncClock_sync_to_slave(&info->extclk, &info->audclk, AV_NOSYNC_THRESHOLD);
+    }
+    
+    if (!info->has_video || !info->texture) {
+        return PRESENT_NO_DEADLINE;
+    }
+    
+    SDL_LockMutex(info->p_mutex);
+    /* pictures decoded before the last seek */
+    while (info->video_buf_size &&
+           info->video_buf[info->video_buf_ridx]->serial != info->seek_serial) {
+        SDL_UnlockMutex(info->p_mutex);
+        picture_queue_pop(info, info->video_buf[info->video_buf_ridx]);
+        SDL_LockMutex(info->p_mutex);
+    }
+    if (!info->video_buf_size) {
+        /* frame_publish wakes us up, no polling */
+        info->present_waiting = 1;
+        SDL_UnlockMutex(info->p_mutex);
+        
+        /* decoder still filling its frame threads, do not let audio run away */
+        if (info->has_audio && !info->audio_started && info->audio_opened) {
+            double deadline = info->refresh_time + AV_PREROLL_TIMEOUT + info->video_decode_latency;
+            if (av_gettime() / 1000000.0 > deadline) {
+                start_audio(info);
+            } else {
+                return now + (int64_t)((deadline - av_gettime() / 1000000.0) * 1000000.0);
             }
-            
-            if (delay < 0.01) {
-                delay = 0.01;
+        }
+        return PRESENT_NO_DEADLINE;
+    }
+    SDL_UnlockMutex(info->p_mutex);
+    
+    /* head picture is not due yet */
+    if (info->frame_timer && now < info->frame_timer) {
+        return info->frame_timer;
+    }
+    if (info->frame_timer) {
+        latencyHistogram_record(&info->stats.present_late, now - info->frame_timer);
+    }
+    
+    FrameInfo *frame_info = info->video_buf[info->video_buf_ridx];
+    AVFrame *frame = frame_info->frame;
+    
+    double pts = frame_info->pts;
+    
+    delay = pts - info->last_frame_pts;
+    if (info->trick_speed) {
+        /* keyframes only: on screen as long as the stretch they stand for lasts at this speed */
+        delay = fabs(delay) / fabs(info->trick_speed);
+        if (delay <= 0 || delay > 1.0)
+            delay = 1.0 / TRICK_PLAY_FPS;
+    } else if (delay <= 0 || delay > 1.0) {
+        /* incorrect delay */
+        delay = info->last_frame_delay;
+    }
+    
+    info->last_frame_pts = pts;
+    info->last_frame_delay = delay;
+    
+    /*
+     * first picture out of a frame threaded decoder arrives
+     * video_decode_latency late, start the audio clock with it
+     * instead of judging every early frame as behind
+     */
+    if (info->has_audio && !info->audio_started) {
+        start_audio(info);
+    }
+    
+    if (get_master_sync_type(info) != AV_SYNC_VIDEO_MASTER) {
+        master_clock = get_master_clock(info);
+        /* get real diff, see how good effect last predict is */
+        rel_diff = pts - master_clock;
+        
+        threshold_delay = delay > AV_SYNC_THRESHOLD ? delay : AV_SYNC_THRESHOLD;
+        
+        /* no master on this serial yet, or a jump no pacing can catch up with: keep the cadence */
+        if (isnan(rel_diff) || fabs(rel_diff) >= AV_NOSYNC_THRESHOLD) {
+            rel_diff = 0;
+        }
+        
+        if (rel_diff <= -threshold_delay) {
+            delay = 0;
+            /* a later picture is already waiting, showing this one only adds to the lag */
+            if (info->opts.framedrop && info->video_buf_size > 1) {
+                info->nb_frames_dropped_late++;
+                picture_queue_pop(info, frame_info);
+                return now;
             }
-            
-            schedule_refresh(info, (int)(delay * 1000));
-            
-            render_frame(info, frame);
-            if (info->video_buf_ridx >= VIDEO_PICTURE_QUEUE_SIZE)
-                info->video_buf_ridx = 0;
-            
-            SDL_LockMutex(info->p_mutex);
-            info->video_buf_size--;
-            SDL_CondSignal(info->p_cond);
-            SDL_UnlockMutex(info->p_mutex);
+        } else if (rel_diff >= threshold_delay) {
+            delay = 2 * delay;
         }
+    }
+    
+    if (delay < 0.01) {
+        delay = 0.01;
+    }
+    
+    /* absolute target, so render time does not add up into drift */
+    if (!info->frame_timer ||
+        now - info->frame_timer > (int64_t)(AV_FRAME_TIMER_RESET * 1000000.0)) {
+        info->frame_timer = now;
+    }
+    info->frame_timer += (int64_t)(delay * 1000000.0);
+    
+    depthGauge_sample(&info->stats.video_q_depth, packetQueue_nb_packets(info->video_q));
+    depthGauge_sample(&info->stats.audio_q_depth, packetQueue_nb_packets(info->audio_q));
+    depthGauge_sample(&info->stats.picture_q_depth, info->video_buf_size);
+    
+    int64_t render_start = av_gettime_relative();
+    latencyHistogram_record(&info->stats.picture_queue, render_start - frame_info->ready_time);
+    render_frame(info, frame);
+    latencyHistogram_record(&info->stats.render, av_gettime_relative() - render_start);
+    info->nb_frames_presented++;
+    if (!info->first_frame_time) {
+        info->first_frame_time = av_gettime_relative();
+        av_log(NULL, AV_LOG_INFO,
+               "[demo log] time to first frame: %.1f ms\n",
+               (info->first_frame_time - info->startup_time) / 1000.0);
+    }
+    syncClock_set(&info->vidclk, pts, frame_info->serial);
+    syncClock_sync_to_slave(&info->extclk,
+                            info->has_audio && info->audio_started ? &info->audclk : &info->vidclk,
+                            AV_NOSYNC_THRESHOLD);
+    picture_queue_pop(info, frame_info);
+    
+    if (info->seek_start_time) {
+        int64_t seek_latency = av_gettime_relative() - info->seek_start_time;
+        latencyHistogram_record(&info->stats.seek, seek_latency);
+        av_log(NULL, AV_LOG_INFO,
+               "[demo log] seek: first frame at %.3f after %.1f ms\n",
+               pts, seek_latency / 1000.0);
+        info->seek_start_time = 0;
+    }
+    
+    return info->frame_timer;
+}
+
+/*
+ * main thread side of a seek. stale packets are flushed right away so the
+ * demuxer and decoders stop working on them, the demux thread does the rest.
+ * flush and request go under w_mutex together, the demuxer samples both
+ * before reading a packet, so nothing read before the seek gets the new serial
+ */
+static void stream_seek_to(VideoInfo *info, int64_t target) {
+    int64_t start_time = info->fmt_ctx && info->fmt_ctx->start_time != AV_NOPTS_VALUE ?
+                         info->fmt_ctx->start_time : 0;
+    
+    if (target < start_time)
+        target = start_time;
+    if (info->fmt_ctx->duration > 0 && target > start_time + info->fmt_ctx->duration)
+        target = start_time + info->fmt_ctx->duration;
+    
+    SDL_LockMutex(info->w_mutex);
+    info->seek_serial++;
+    packetQueue_flush(info->video_q, info->seek_serial);
+    packetQueue_flush(info->audio_q, info->seek_serial);
+    info->seek_pos = target;
+    info->seek_speed = info->trick_speed;
+    info->seek_req = 1;
+    SDL_CondSignal(info->w_cond);
+    SDL_UnlockMutex(info->w_mutex);
+    /* an idle demux task has no cond to wait on */
+    if (info->demux_task) {
+        executor_wake(info->demux_task);
+    }
+    
+    /* decoder may sit on a full picture queue */
+    SDL_LockMutex(info->p_mutex);
+    SDL_CondBroadcast(info->p_cond);
+    SDL_UnlockMutex(info->p_mutex);
+    
+    /* next picture goes up as soon as it lands */
+    info->frame_timer = 0;
+    info->seek_start_time = av_gettime_relative();
+}
+
+/* where playback is now, AV_TIME_BASE */
+static int64_t stream_position(VideoInfo *info) {
+    double clock = get_master_clock(info);
+    return (int64_t)((isnan(clock) ? info->last_frame_pts : clock) * AV_TIME_BASE);
+}
+
+static void stream_seek(VideoInfo *info, double pos, int relative) {
+    int64_t start_time = info->fmt_ctx && info->fmt_ctx->start_time != AV_NOPTS_VALUE ?
+                         info->fmt_ctx->start_time : 0;
+    
+    /* streams are not set up yet */
+    if (!info->v_st && !info->a_st)
+        return;
+    if (relative) {
+        stream_seek_to(info, stream_position(info) + (int64_t)(pos * AV_TIME_BASE));
     } else {
-        schedule_refresh(info, 200);
+        stream_seek_to(info, start_time + (int64_t)(pos * AV_TIME_BASE));
     }
 }
 
-static int start_playing(char *in_filename) {
-    int rc = 0;
-    int thread_error_code = 0;
-    VideoInfo *video_info = NULL;
+/*
+ * 0 back to normal, otherwise keyframes only, forward or backward. what is
+ * queued was read for the old speed, so it goes on like a seek from the
+ * current picture
+ */
+static void stream_set_speed(VideoInfo *info, double speed) {
+    /* the position is taken before the master clock changes with the speed */
+    int64_t pos = 0;
+    
+    if (!info->v_st || speed == info->trick_speed)
+        return;
+    pos = stream_position(info);
+    info->trick_speed = speed;
+    
+    /* no audio is read meanwhile, what the ring still holds is from before */
+    SDL_LockMutex(info->w_mutex);
+    if (info->audio_opened && info->audio_started)
+        SDL_PauseAudioDevice(info->audio_dev, speed != 0);
+    SDL_UnlockMutex(info->w_mutex);
+    
+    av_log(NULL, AV_LOG_INFO, "[demo log] playback speed %gx%s\n",
+           speed ? speed : 1.0, speed ? ", keyframes only" : "");
+    stream_seek_to(info, pos);
+}
+
+static void handle_key(VideoInfo *info, SDL_Keycode key) {
+    switch (key) {
+        case SDLK_LEFT:
+            stream_seek(info, -10.0, 1);
+            break;
+        case SDLK_RIGHT:
+            stream_seek(info, 10.0, 1);
+            break;
+        case SDLK_DOWN:
+            stream_seek(info, -60.0, 1);
+            break;
+        case SDLK_UP:
+            stream_seek(info, 60.0, 1);
+            break;
+        case SDLK_HOME:
+            stream_seek(info, 0.0, 0);
+            break;
+        case SDLK_f:
+            /* 2x .. 32x, from rewind straight to 2x forward */
+            stream_set_speed(info, info->trick_speed > 0 ?
+                             FFMIN(info->trick_speed * 2, TRICK_PLAY_MAX_SPEED) : TRICK_PLAY_MIN_SPEED);
+            break;
+        case SDLK_r:
+            stream_set_speed(info, info->trick_speed < 0 ?
+                             FFMAX(info->trick_speed * 2, -TRICK_PLAY_MAX_SPEED) : -TRICK_PLAY_MIN_SPEED);
+            break;
+        case SDLK_n:
+            stream_set_speed(info, 0.0);
+            break;
+        default:
+            /* 0-9 jump to that tenth of the file */
+            if (key >= SDLK_0 && key <= SDLK_9 && info->fmt_ctx && info->fmt_ctx->duration > 0) {
+                stream_seek(info, (key - SDLK_0) * info->fmt_ctx->duration / 10.0 / AV_TIME_BASE, 0);
+            }
+            break;
+    }
+}
+
+/*
+ * presentation scheduler on the main thread, which owns the window and renderer:
+ * sleep on the event queue until the deadline, then av_usleep the sub-millisecond rest
+ */
+static int wait_present_event(int64_t deadline, SDL_Event *event) {
+    int64_t remain = 0;
+    int timeout = PRESENT_MAX_WAIT_MS;
+    
+    if (deadline != PRESENT_NO_DEADLINE) {
+        remain = deadline - av_gettime_relative();
+        if (remain <= PRESENT_FINE_SLEEP_US) {
+            if (remain > 0)
+                av_usleep((unsigned)remain);
+            return SDL_PollEvent(event);
+        }
+        timeout = (int)((remain - PRESENT_FINE_SLEEP_US) / 1000);
+        if (timeout > PRESENT_MAX_WAIT_MS)
+            timeout = PRESENT_MAX_WAIT_MS;
+    }
+    return SDL_WaitEventTimeout(event, timeout);
+}
+
+/* out.mkv becomes out-2.mkv for the second player, players must not share a file */
+static void number_record_filename(VideoInfo *info, int number) {
+    const char *name = info->opts.record_filename;
+    const char *slash = strrchr(name, '/');
+    const char *dot = strrchr(slash ? slash : name, '.');
+    int len = dot ? (int)(dot - name) : (int)strlen(name);
+    
+    snprintf(info->record_filename, sizeof(info->record_filename),
+             "%.*s-%d%s", len, name, number, dot ? dot : "");
+    info->opts.record_filename = info->record_filename;
+}
+
+/* number > 0 when several players run, see number_record_filename */
+static VideoInfo *player_open(const char *in_filename, const PlayerOptions *opts, Executor *executor, int number) {
+    VideoInfo *info = malloc(sizeof(VideoInfo));
     
     //init core struct
-    video_info = malloc(sizeof(VideoInfo));
-    videoInfo_init(video_info);
+    videoInfo_init(info);
+    info->startup_time = av_gettime_relative();
+    strcpy(info->in_filename, in_filename);
+    if (opts) {
+        info->opts = *opts;
+    }
+    if (info->opts.record_filename && number > 0) {
+        number_record_filename(info, number);
+    }
+    info->executor = executor;
     
-    strcpy(video_info->in_filename, in_filename);
+    info->demux_t = SDL_CreateThread(demux_thread, "demux_thread", info);
+    
+    /* window and renderer come up while the demuxer probes, shown once the size is known */
+    if (info->opts.fast_start) {
+        init_video_window(info, 640, 480, SDL_WINDOW_HIDDEN);
+    }
+    return info;
+}
+
+static int player_close(VideoInfo *info) {
+    int err_code = info->err_code;
+    double elapsed = (av_gettime_relative() - info->startup_time) / 1000000.0;
+    
+    if (info->has_video && elapsed > 0) {
+        av_log(NULL, AV_LOG_INFO,
+               "[demo log] %s: %lld pictures presented (%.1f fps), %.1f KB uploaded per picture\n",
+               info->in_filename,
+               (long long)info->nb_frames_presented,
+               info->nb_frames_presented / elapsed,
+               info->nb_uploads ? info->bytes_uploaded / 1024.0 / info->nb_uploads : 0.0);
+    }
+    videoInfo_destory(info);
+    free(info);
+    return err_code;
+}
+
+static int player_index(VideoInfo **players, int nb_players, VideoInfo *info) {
+    for (int i = 0; i < nb_players; i++) {
+        if (players[i] == info)
+            return i;
+    }
+    return -1;
+}
+
+static VideoInfo *player_for_window(VideoInfo **players, int nb_players, Uint32 window_id) {
+    for (int i = 0; i < nb_players; i++) {
+        if (players[i]->window && SDL_GetWindowID(players[i]->window) == window_id)
+            return players[i];
+    }
+    return NULL;
+}
+
+/* a stale event may still name a player that is gone, that is not an error */
+static int player_remove(VideoInfo **players, int *nb_players, VideoInfo *info) {
+    int idx = player_index(players, *nb_players, info);
+    
+    if (idx < 0)
+        return 0;
+    memmove(players + idx, players + idx + 1, (*nb_players - idx - 1) * sizeof(VideoInfo *));
+    (*nb_players)--;
+    return player_close(info);
+}
+
+/*
+ * video wall summary: everything presented and dropped since the players
+ * started. a box keeps up with N streams as long as nothing gets dropped
+ */
+static void report_players(VideoInfo **players, int nb_players) {
+    int64_t now = av_gettime_relative();
+    int64_t presented = 0, dropped = 0;
+    double fps = 0.0, upload_rate = 0.0;
+    
+    for (int i = 0; i < nb_players; i++) {
+        VideoInfo *info = players[i];
+        double elapsed = (now - info->startup_time) / 1000000.0;
+        if (elapsed > 0) {
+            fps += info->nb_frames_presented / elapsed;
+            upload_rate += info->bytes_uploaded / elapsed;
+        }
+        presented += info->nb_frames_presented;
+        dropped += info->nb_frames_dropped_early + info->nb_frames_dropped_late;
+    }
+    av_log(NULL, AV_LOG_INFO,
+           "[wall] %d players: %.1f fps presented, %.1f MB/s uploaded, %lld pictures shown, %lld dropped (%.2f%%)\n",
+           nb_players,
+           fps,
+           upload_rate / (1024 * 1024),
+           (long long)presented,
+           (long long)dropped,
+           presented + dropped ? 100.0 * dropped / (presented + dropped) : 0.0);
+}
+
+/*
+ * one event loop for every player: each refresh_frame returns its next
+ * deadline, the loop sleeps until the earliest one or an event. players
+ * are independent otherwise, own threads, own audio device, own window;
+ * with -workers their demux and video decode share one executor instead
+ */
+static int start_playing(const char **in_filenames, int nb_inputs, const PlayerOptions *opts) {
+    int rc = 0;
+    int thread_error_code = 0;
+    int err_code = 0;
+    VideoInfo *players[MAX_PLAYERS];
+    int nb_players = 0;
+    int instances = opts && opts->instances > 1 ? opts->instances : 1;
+    int64_t last_report = 0;
+    VideoInfo *info = NULL;
+    Executor *executor = NULL;
+    
+    pipelineStats_install_signal();
     
     //init SDL
-    CHECK_ERROR((SDL_Init(SDL_INIT_VIDEO)),
+    /* audio here, once: SDL_OpenAudioDevice does not init it and players open devices on their own threads */
+    CHECK_ERROR((SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO)),
                 "failed to init SDL",
                 AVERROR_UNKNOWN,
                 __exit);
     
-    video_info->demux_t = SDL_CreateThread(demux_thread, "demux_thread", video_info);
+    /* threads follow the core count, not the number of streams */
+    if (opts && opts->workers) {
+        CHECK_ERROR(!(executor = malloc(sizeof(Executor))),
+                    "failed to allocate executor",
+                    AVERROR(ENOMEM),
+                    __exit)
+        CHECK_ERROR(((rc = executor_init(executor, opts->workers)) < 0),
+                    "failed to start executor workers",
+                    0, __exit)
+    }
     
-    //init video SDL component (must be initialized in main thread)
-    if (video_info->v_c) {
-        init_video_SDL_component(video_info, video_info->v_c->width, video_info->v_c->height);
+    /* -instances repeats the inputs, loads a box with N copies of one stream */
+    for (int i = 0; i < nb_inputs * instances; i++) {
+        if (nb_players == MAX_PLAYERS) {
+            av_log(NULL, AV_LOG_WARNING, "[demo log] more than %d players, the rest is ignored\n", MAX_PLAYERS);
+            break;
+        }
+        players[nb_players++] = player_open(in_filenames[i % nb_inputs], opts, executor,
+                                            nb_inputs * instances > 1 ? i + 1 : 0);
     }
+    last_report = av_gettime_relative();
     
-    for(;;) {
+    while (nb_players > 0) {
         SDL_Event event;
-        SDL_WaitEvent(&event);
+        int64_t deadline = PRESENT_NO_DEADLINE;
+        
+        if (pipelineStats_dump_requested()) {
+            for (int i = 0; i < nb_players; i++)
+                pipelineStats_dump(&players[i]->stats, nb_players > 1 ? players[i]->in_filename : "stats");
+        }
+        if (nb_players > 1 && av_gettime_relative() - last_report > WALL_REPORT_INTERVAL) {
+            report_players(players, nb_players);
+            last_report = av_gettime_relative();
+        }
+        
+        for (int i = 0; i < nb_players; i++)
+            deadline = FFMIN(deadline, refresh_frame(players[i]));
+        if (!wait_present_event(deadline, &event))
+            continue;
         switch(event.type) {
                 
             case SDL_QUIT:
                 fprintf(stderr, "receive a QUIT event: %d\n", event.type);
-                video_info->quit = 1;
                 goto __exit;
                 
+            case USER_EVENT_PLAYER_DONE:
+                if ((err_code = player_remove(players, &nb_players, event.user.data1)) && !thread_error_code)
+                    thread_error_code = err_code;
+                break;
+                
             case USER_EVENT_VCODEC_READY:
-                init_video_SDL_component(video_info, video_info->v_c->width, video_info->v_c->height);
-                schedule_refresh(video_info, 40);
+                info = event.user.data1;
+                if (player_index(players, nb_players, info) >= 0)
+                    init_video_SDL_component(info, info->v_c->width, info->v_c->height);
                 break;
                 
-            case USER_REFRESH_FRAME:
-                refresh_frame(event.user.data1);
+            case USER_EVENT_FRAME_READY:
+                /* nothing to do, refresh_frame runs on the next turn */
+                break;
+                
+            case SDL_KEYDOWN:
+                if ((info = player_for_window(players, nb_players, event.key.windowID)))
+                    handle_key(info, event.key.keysym.sym);
+                break;
+                
+            case SDL_WINDOWEVENT:
+                if (!(info = player_for_window(players, nb_players, event.window.windowID)))
+                    break;
+                if (event.window.event == SDL_WINDOWEVENT_CLOSE) {
+                    if ((err_code = player_remove(players, &nb_players, info)) && !thread_error_code)
+                        thread_error_code = err_code;
+                } else if (event.window.event == SDL_WINDOWEVENT_SIZE_CHANGED) {
+                    update_output_size(info);
+                }
                 break;
             default:
                 break;
@@ -652,12 +2407,17 @@ static int start_playing(char *in_filename) {
     
 __exit:
     
-    thread_error_code = video_info->err_code;
-    
-    if (video_info) {
-        videoInfo_destory(video_info);
-        free(video_info);
-        video_info = NULL;
+    if (nb_players > 1) {
+        report_players(players, nb_players);
+    }
+    for (int i = 0; i < nb_players; i++) {
+        if ((err_code = player_close(players[i])) && !thread_error_code)
+            thread_error_code = err_code;
+    }
+    /* players are closed, no task is left */
+    if (executor) {
+        executor_destory(executor);
+        free(executor);
     }
     
     SDL_Quit();
@@ -668,18 +2428,128 @@ __exit:
     return rc;
 }
 
+static int run_benchmark(const char *in_filename, const PlayerOptions *opts) {
+    int rc = 0;
+    VideoInfo *info = NULL;
+    int64_t start_time = 0;
+    double wall_time = 0.0, cpu_start = 0.0, cpu_total = 0.0, convert_cpu = 0.0;
+    
+    info = malloc(sizeof(VideoInfo));
+    videoInfo_init(info);
+    info->startup_time = av_gettime_relative();
+    strcpy(info->in_filename, in_filename);
+    info->opts = *opts;
+    /* no window, no audio device: SDL only lends us threads and locks */
+    info->headless = 1;
+    /* stages are timed per thread, no shared workers here */
+    info->opts.workers = 0;
+    pipelineStats_install_signal();
+    
+    start_time = av_gettime_relative();
+    cpu_start = process_cpu_time();
+    info->demux_t = SDL_CreateThread(demux_thread, "demux_thread", info);
+    
+    /* stand in for refresh_frame: take pictures out as soon as they land */
+    SDL_LockMutex(info->p_mutex);
+    while (!info->err_code) {
+        if (info->video_buf_size > 0) {
+            FrameInfo *frame_info = info->video_buf[info->video_buf_ridx];
+            depthGauge_sample(&info->stats.video_q_depth, packetQueue_nb_packets(info->video_q));
+            depthGauge_sample(&info->stats.audio_q_depth, packetQueue_nb_packets(info->audio_q));
+            depthGauge_sample(&info->stats.picture_q_depth, info->video_buf_size);
+            latencyHistogram_record(&info->stats.picture_queue,
+                                    av_gettime_relative() - frame_info->ready_time);
+            SDL_UnlockMutex(info->p_mutex);
+            picture_queue_pop(info, frame_info);
+            SDL_LockMutex(info->p_mutex);
+            continue;
+        }
+        if (pipelineStats_dump_requested()) {
+            pipelineStats_dump(&info->stats, "stats");
+        }
+        if (info->demux_eof &&
+            (!info->has_video || info->video_eof) &&
+            (!info->has_audio || info->audio_eof))
+            break;
+        SDL_CondWaitTimeout(info->p_cond, info->p_mutex, 100);
+    }
+    SDL_UnlockMutex(info->p_mutex);
+    
+    wall_time = (av_gettime_relative() - start_time) / 1000000.0;
+    cpu_total = process_cpu_time() - cpu_start;
+    if (info->sws_pool) {
+        swsPool_wait(info->sws_pool);
+        convert_cpu = info->sws_pool->cpu_time;
+    }
+    rc = info->err_code;
+    
+    if (!rc && wall_time > 0) {
+        av_log(NULL, AV_LOG_INFO,
+               "[bench] %s, mode: %s\n",
+               in_filename,
+               opts->benchmark == BENCHMARK_DECODE ? "decode" : "decode+convert");
+        av_log(NULL, AV_LOG_INFO,
+               "[bench] wall %.3f s, %lld packets (%.1f pkt/s), %.2f MB demuxed (%.2f MB/s)\n",
+               wall_time,
+               (long long)info->nb_packets_read,
+               info->nb_packets_read / wall_time,
+               info->bytes_read / (1024.0 * 1024.0),
+               info->bytes_read / (1024.0 * 1024.0) / wall_time);
+        av_log(NULL, AV_LOG_INFO,
+               "[bench] %lld video frames (%.1f fps), %lld audio frames (%.1f fps)\n",
+               (long long)info->nb_video_frames,
+               info->nb_video_frames / wall_time,
+               (long long)info->nb_audio_frames,
+               info->nb_audio_frames / wall_time);
+        /* codec internal threads are not ours to time, they end up in "other" */
+        av_log(NULL, AV_LOG_INFO,
+               "[bench] cpu: demux %.3f s, video decode %.3f s, audio decode %.3f s, convert %.3f s, other %.3f s, total %.3f s\n",
+               info->demux_cpu,
+               info->video_cpu,
+               info->audio_cpu,
+               convert_cpu,
+               FFMAX(0.0, cpu_total - info->demux_cpu - info->video_cpu - info->audio_cpu - convert_cpu),
+               cpu_total);
+    }
+    
+    videoInfo_destory(info);
+    free(info);
+    
+    RETURN_ERROR_CHECK(rc)
+    return rc;
+}
+
 void start_play_real_video(void) {
-    start_playing("");
+    const char *in_filename = "";
+    start_playing(&in_filename, 1, NULL);
+}
+
+int start_play_video(const char *in_filename, const PlayerOptions *opts) {
+    return start_playing(&in_filename, 1, opts);
+}
+
+int start_play_videos(const char **in_filenames, int nb_inputs, const PlayerOptions *opts) {
+    return start_playing(in_filenames, nb_inputs, opts);
+}
+
+int start_benchmark(const char *in_filename, const PlayerOptions *opts) {
+    return run_benchmark(in_filename, opts);
 }
 
 #if 0
 int main(int argc, char **argv) {
-    if (argc < 2) {
-        printf("Usage command: <in_filename>");
+    PlayerOptions opts;
+    playerOptions_init(&opts);
+    int idx = playerOptions_parse(&opts, argc, argv);
+    if (idx < 0 || idx >= argc) {
+        printf("Usage command: [-threads auto|N] [-thread_type auto|frame|slice] [-sws_threads auto|N] [-scaler fast|bilinear|bicubic|lanczos] [-pictq auto|N] [-pictq_max N] [-pictq_budget MB] [-accurate_seek 0|1] [-renderer auto|software] [-framedrop 0|1] [-skip_nonref 0|1] [-sync audio|video|ext] [-readahead KB] [-probesize bytes] [-analyzeduration us] [-fast 0|1] [-instances N] [-workers 0|auto|N] [-hugepages 0|1] [-record file] [-benchmark decode|convert] <in_filename> [in_filename ...]");
         return -1;
     }
-    char *in_filename = argv[1];
-    start_playing(in_filename);
+    char *in_filename = argv[idx];
+    if (opts.benchmark) {
+        return run_benchmark(in_filename, &opts);
+    }
+    start_playing((const char **)argv + idx, argc - idx, &opts);
     return 0;
 }
 #endif
@@ -9,5 +9,13 @@
 #define player_h
 
 #include <stdio.h>
+#include "player_options.h"
+
 void start_play_real_video(void);
+int start_play_video(const char *in_filename, const PlayerOptions *opts);
+/* one player per input (times opts->instances), all in this process and one event loop */
+int start_play_videos(const char **in_filenames, int nb_inputs, const PlayerOptions *opts);
+
+/* headless throughput run, opts->benchmark picks decode only or decode + convert */
+int start_benchmark(const char *in_filename, const PlayerOptions *opts);
 #endif /* player_h */
@@ -0,0 +1,140 @@
+//
+//  player_options.c
+//  ffmpeg_proj
+//
+//  Created by HorsonChan on 2026/10/17.
+//
+
+#include <string.h>
+#include <stdlib.h>
+#include "player_options.h"
+
+void playerOptions_init(PlayerOptions *opts) {
+    memset(opts, 0, sizeof(PlayerOptions));
+    opts->decoder_threads = DEFAULT_DECODER_THREADS;
+    opts->decoder_thread_type = DEFAULT_DECODER_THREAD_TYPE;
+    opts->sws_threads = DEFAULT_SWS_THREADS;
+    opts->scaler_flags = DEFAULT_SCALER_FLAGS;
+    opts->picture_queue_size = VIDEO_PICTURE_QUEUE_SIZE;
+    opts->picture_queue_adaptive = 0;
+    opts->picture_queue_max = DEFAULT_PICTURE_QUEUE_MAX;
+    opts->picture_queue_budget = DEFAULT_PICTURE_QUEUE_BUDGET;
+    opts->accurate_seek = DEFAULT_ACCURATE_SEEK;
+    opts->framedrop = DEFAULT_FRAMEDROP;
+    opts->skip_nonref = DEFAULT_SKIP_NONREF;
+    opts->sync_type = AV_SYNC_AUDIO_MASTER;
+    opts->read_ahead_size = DEFAULT_READ_AHEAD_SIZE;
+    opts->probesize = 0;
+    opts->analyzeduration = 0;
+    opts->fast_start = 0;
+    opts->instances = 1;
+    opts->workers = 0;
+    opts->hugepages = 0;
+    opts->record_filename = NULL;
+}
+
+static int __parse_thread_type(const char *value) {
+    if (!strcmp(value, "frame")) return FF_THREAD_FRAME;
+    if (!strcmp(value, "slice")) return FF_THREAD_SLICE;
+    if (!strcmp(value, "auto")) return FF_THREAD_FRAME | FF_THREAD_SLICE;
+    return -1;
+}
+
+/* speed against quality, fast for a video wall of thumbnails, lanczos for one big window */
+static int __parse_scaler(const char *value) {
+    if (!strcmp(value, "fast")) return SWS_FAST_BILINEAR;
+    if (!strcmp(value, "bilinear")) return SWS_BILINEAR;
+    if (!strcmp(value, "bicubic")) return SWS_BICUBIC;
+    if (!strcmp(value, "lanczos")) return SWS_LANCZOS;
+    return -1;
+}
+
+int playerOptions_parse(PlayerOptions *opts, int argc, char **argv) {
+    int i = 1;
+    
+    for (; i < argc && argv[i][0] == '-'; i += 2) {
+        const char *key = argv[i] + 1;
+        const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+        
+        if (!value) {
+            av_log(NULL, AV_LOG_ERROR, "[demo log] missing value for option -%s\n", key);
+            return -1;
+        }
+        
+        if (!strcmp(key, "threads")) {
+            opts->decoder_threads = !strcmp(value, "auto") ? 0 : atoi(value);
+        } else if (!strcmp(key, "thread_type")) {
+            if ((opts->decoder_thread_type = __parse_thread_type(value)) < 0) {
+                av_log(NULL, AV_LOG_ERROR, "[demo log] unknown thread type: %s\n", value);
+                return -1;
+            }
+        } else if (!strcmp(key, "sws_threads")) {
+            opts->sws_threads = !strcmp(value, "auto") ? 0 : atoi(value);
+        } else if (!strcmp(key, "scaler")) {
+            if ((opts->scaler_flags = __parse_scaler(value)) < 0) {
+                av_log(NULL, AV_LOG_ERROR, "[demo log] unknown scaler: %s\n", value);
+                return -1;
+            }
+        } else if (!strcmp(key, "pictq")) {
+            if (!strcmp(value, "auto")) {
+                opts->picture_queue_adaptive = 1;
+            } else {
+                opts->picture_queue_size = atoi(value);
+            }
+        } else if (!strcmp(key, "pictq_max")) {
+            opts->picture_queue_max = atoi(value);
+        } else if (!strcmp(key, "pictq_budget")) {
+            /* in megabytes */
+            opts->picture_queue_budget = (int64_t)atoi(value) * 1024 * 1024;
+        } else if (!strcmp(key, "framedrop")) {
+            opts->framedrop = atoi(value);
+        } else if (!strcmp(key, "skip_nonref")) {
+            opts->skip_nonref = atoi(value);
+        } else if (!strcmp(key, "hugepages")) {
+            opts->hugepages = atoi(value);
+        } else if (!strcmp(key, "renderer")) {
+            opts->software_renderer = !strcmp(value, "software");
+        } else if (!strcmp(key, "accurate_seek")) {
+            opts->accurate_seek = atoi(value);
+        } else if (!strcmp(key, "readahead")) {
+            /* in kilobytes */
+            opts->read_ahead_size = (int64_t)atoi(value) * 1024;
+        } else if (!strcmp(key, "probesize")) {
+            opts->probesize = strtoll(value, NULL, 10);
+        } else if (!strcmp(key, "analyzeduration")) {
+            opts->analyzeduration = strtoll(value, NULL, 10);
+        } else if (!strcmp(key, "instances")) {
+            opts->instances = atoi(value);
+        } else if (!strcmp(key, "workers")) {
+            opts->workers = !strcmp(value, "auto") ? -1 : atoi(value);
+        } else if (!strcmp(key, "record")) {
+            opts->record_filename = value;
+        } else if (!strcmp(key, "fast")) {
+            opts->fast_start = atoi(value);
+        } else if (!strcmp(key, "sync")) {
+            if (!strcmp(value, "audio")) {
+                opts->sync_type = AV_SYNC_AUDIO_MASTER;
+            } else if (!strcmp(value, "video")) {
+                opts->sync_type = AV_SYNC_VIDEO_MASTER;
+            } else if (!strcmp(value, "ext")) {
+                opts->sync_type = AV_SYNC_EXTERNAL_CLOCK;
+            } else {
+                av_log(NULL, AV_LOG_ERROR, "[demo log] unknown sync type: %s\n", value);
+                return -1;
+            }
+        } else if (!strcmp(key, "benchmark")) {
+            if (!strcmp(value, "decode")) {
+                opts->benchmark = BENCHMARK_DECODE;
+            } else if (!strcmp(value, "convert")) {
+                opts->benchmark = BENCHMARK_CONVERT;
+            } else {
+                av_log(NULL, AV_LOG_ERROR, "[demo log] unknown benchmark mode: %s\n", value);
+                return -1;
+            }
+        } else {
+            av_log(NULL, AV_LOG_ERROR, "[demo log] unknown option -%s\n", key);
+            return -1;
+        }
+    }
+    return i;
+}
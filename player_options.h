@@ -0,0 +1,112 @@
+//
+//  player_options.h
+//  ffmpeg_proj
+//
+//  Created by HorsonChan on 2026/10/17.
+//
+
+#ifndef player_options_h
+#define player_options_h
+
+#include <stdio.h>
+#include <libavcodec/avcodec.h>
+#include <libswscale/swscale.h>
+
+/* 0 lets the player pick one decoder thread per core */
+#define DEFAULT_DECODER_THREADS 0
+#define DEFAULT_DECODER_THREAD_TYPE (FF_THREAD_FRAME | FF_THREAD_SLICE)
+/* 0 lets the player use half of the cores for pixel format conversion */
+#define DEFAULT_SWS_THREADS 0
+/* scaler used when pictures are converted down to the drawable size */
+#define DEFAULT_SCALER_FLAGS SWS_BILINEAR
+/* picture queue depth without -pictq */
+#define VIDEO_PICTURE_QUEUE_SIZE 3
+/* adaptive picture queue: upper bound in pictures and in bytes */
+#define DEFAULT_PICTURE_QUEUE_MAX 16
+#define DEFAULT_PICTURE_QUEUE_BUDGET (256 * 1024 * 1024)
+#define DEFAULT_ACCURATE_SEEK 1
+#define DEFAULT_FRAMEDROP 1
+#define DEFAULT_SKIP_NONREF 1
+/* read-ahead ring in front of the demuxer, 0 lets avformat open the input itself */
+#define DEFAULT_READ_AHEAD_SIZE (4 * 1024 * 1024)
+/* fast start probing limits, unless -probesize / -analyzeduration say otherwise */
+#define FAST_START_PROBESIZE (256 * 1024)
+#define FAST_START_ANALYZEDURATION 500000
+
+/* which clock the others follow, a missing stream falls back (see get_master_sync_type) */
+enum {
+    AV_SYNC_AUDIO_MASTER = 0,
+    AV_SYNC_VIDEO_MASTER,
+    AV_SYNC_EXTERNAL_CLOCK,     /* free running system clock */
+};
+
+/* headless run as fast as possible, no window and no audio device */
+enum {
+    BENCHMARK_NONE = 0,
+    BENCHMARK_DECODE,           /* demux + decode */
+    BENCHMARK_CONVERT,          /* demux + decode + picture queue conversion */
+};
+
+typedef struct PlayerOptions {
+    /* decoder threading, applied to both audio and video codec */
+    int decoder_threads;
+    int decoder_thread_type;    /* FF_THREAD_FRAME and/or FF_THREAD_SLICE */
+    
+    /* sws conversion workers, one horizontal slice each */
+    int sws_threads;
+    
+    /* SWS_* scaler for pictures larger than the window's drawable, see -scaler */
+    int scaler_flags;
+    
+    int benchmark;
+    
+    /*
+     * picture queue depth; with picture_queue_adaptive it starts there and
+     * follows the decode time jitter within picture_queue_max and the budget
+     */
+    int picture_queue_size;
+    int picture_queue_adaptive;
+    int picture_queue_max;
+    int64_t picture_queue_budget;   /* bytes */
+    
+    /* after a seek, decode and drop everything before the target instead of showing the keyframe */
+    int accurate_seek;
+    
+    /* SDL_RENDERER_SOFTWARE, runs without a gpu */
+    int software_renderer;
+    
+    /* converted picture buffers on transparent huge pages, fewer tlb misses at 4K */
+    int hugepages;
+    
+    /* video behind the audio clock: drop late pictures, then let the decoder skip non reference frames */
+    int framedrop;
+    int skip_nonref;
+    
+    /* master clock, AV_SYNC_* */
+    int sync_type;
+    
+    /* input: read-ahead ring in bytes, probing limits for a faster start (0 keeps avformat's) */
+    int64_t read_ahead_size;
+    int64_t probesize;          /* bytes */
+    int64_t analyzeduration;    /* microseconds */
+    
+    /* bounded probing, no probing at all if the header describes every stream, window up before the codecs */
+    int fast_start;
+    
+    /* start_play_videos runs the inputs this many times over, video wall load test */
+    int instances;
+    
+    /* stream copy of what is read into this file (-record), container by extension, NULL records nothing.
+     * with several players each gets its own, numbered out-1.mkv, out-2.mkv ... */
+    const char *record_filename;
+    
+    /* demux and video decode of every player as tasks on this many shared workers, < 0 one per core, 0 a thread per stream */
+    int workers;
+} PlayerOptions;
+
+void playerOptions_init(PlayerOptions *opts);
+
+/* parse "-key value" pairs, returns index of the first non option argument or < 0 */
+int playerOptions_parse(PlayerOptions *opts, int argc, char **argv);
+
+#endif /* player_options_h */
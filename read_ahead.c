@@ -0,0 +1,248 @@
+//
+//  read_ahead.c
+//  ffmpeg_proj
+//
+//  Created by HorsonChan on 2026/10/17.
+//
+
+#include "read_ahead.h"
+#include "common.h"
+#include <libavutil/time.h>
+
+static int __interrupt(void *opaque) {
+    ReadAhead *ra = (ReadAhead *)opaque;
+    return ra->abort_request;
+}
+
+/* fills the ring from the source, carries out seeks */
+static int __reader_thread(void *data) {
+    ReadAhead *ra = (ReadAhead *)data;
+    int64_t ret = 0;
+    size_t offset = 0, n = 0;
+    
+    SDL_LockMutex(ra->mutex);
+    while (!ra->abort_request) {
+        if (ra->seek_req) {
+            int64_t target = ra->seek_pos;
+            SDL_UnlockMutex(ra->mutex);
+            ret = avio_seek(ra->src, target, SEEK_SET);
+            SDL_LockMutex(ra->mutex);
+            if (ret >= 0) {
+                ra->head = ra->tail = 0;
+                ra->pos = ret;
+                ra->eof = 0;
+                ra->error = 0;
+            }
+            ra->seek_ret = ret;
+            ra->seek_req = 0;
+            SDL_CondBroadcast(ra->cond);
+            continue;
+        }
+        if (ra->eof || ra->error || ra->tail - ra->head == (int64_t)ra->capacity) {
+            SDL_CondWait(ra->cond, ra->mutex);
+            continue;
+        }
+    
+        /* the free stretch past tail is ours until tail moves, nobody else writes there */
+        offset = ra->tail % ra->capacity;
+        n = FFMIN(ra->capacity - (size_t)(ra->tail - ra->head), ra->capacity - offset);
+        n = FFMIN(n, READ_AHEAD_IO_SIZE);
+        SDL_UnlockMutex(ra->mutex);
+        ret = avio_read_partial(ra->src, ra->buf + offset, (int)n);
+        SDL_LockMutex(ra->mutex);
+    
+        /* a seek came in meanwhile, these bytes are from the old position */
+        if (ra->seek_req)
+            continue;
+        if (ret == AVERROR_EOF || ret == 0) {
+            ra->eof = 1;
+        } else if (ret < 0) {
+            if (ret != AVERROR_EXIT)
+                av_log(NULL, AV_LOG_ERROR, "[demo log] read-ahead: %s\n", av_err2str((int)ret));
+            ra->error = (int)ret;
+        } else {
+            ra->tail += ret;
+            ra->bytes_read += ret;
+        }
+        SDL_CondBroadcast(ra->cond);
+    }
+    SDL_UnlockMutex(ra->mutex);
+    return 0;
+}
+
+/* avio read callback, runs on the demux thread */
+static int __read_packet(void *opaque, uint8_t *buf, int buf_size) {
+    ReadAhead *ra = (ReadAhead *)opaque;
+    int64_t stall_start = 0, stall = 0;
+    size_t offset = 0;
+    int rc = 0;
+    
+    SDL_LockMutex(ra->mutex);
+    while (ra->tail == ra->head && !ra->eof && !ra->error && !ra->abort_request) {
+        if (!stall_start)
+            stall_start = av_gettime_relative();
+        SDL_CondWait(ra->cond, ra->mutex);
+    }
+    if (stall_start) {
+        stall = av_gettime_relative() - stall_start;
+        ra->nb_stalls++;
+        ra->stall_time += stall;
+        if (ra->stall)
+            latencyHistogram_record(ra->stall, stall);
+    }
+    
+    if (ra->tail == ra->head) {
+        rc = ra->abort_request ? AVERROR_EXIT : ra->error ? ra->error : AVERROR_EOF;
+    } else {
+        offset = ra->head % ra->capacity;
+        rc = (int)FFMIN((int64_t)buf_size, ra->tail - ra->head);
+        rc = (int)FFMIN((size_t)rc, ra->capacity - offset);
+        memcpy(buf, ra->buf + offset, rc);
+        ra->head += rc;
+        ra->pos += rc;
+        /* room for the reader again */
+        SDL_CondBroadcast(ra->cond);
+    }
+    SDL_UnlockMutex(ra->mutex);
+    return rc;
+}
+
+/* avio seek callback: inside the ring it is a skip, otherwise the reader thread seeks the source */
+static int64_t __seek(void *opaque, int64_t offset, int whence) {
+    ReadAhead *ra = (ReadAhead *)opaque;
+    int64_t target = 0, ret = 0;
+    
+    whence &= ~AVSEEK_FORCE;
+    if (whence == AVSEEK_SIZE)
+        return ra->size >= 0 ? ra->size : AVERROR(ENOSYS);
+    
+    SDL_LockMutex(ra->mutex);
+    if (whence == SEEK_SET) {
+        target = offset;
+    } else if (whence == SEEK_CUR) {
+        target = ra->pos + offset;
+    } else if (whence == SEEK_END && ra->size >= 0) {
+        target = ra->size + offset;
+    } else {
+        ret = AVERROR(ENOSYS);
+        goto __exit;
+    }
+    
+    if (target >= ra->pos && target <= ra->pos + (ra->tail - ra->head)) {
+        ra->head += target - ra->pos;
+        ra->pos = target;
+        SDL_CondBroadcast(ra->cond);
+        ret = target;
+    } else if (!ra->src->seekable) {
+        ret = AVERROR(ESPIPE);
+    } else {
+        ra->seek_pos = target;
+        ra->seek_req = 1;
+        SDL_CondBroadcast(ra->cond);
+        while (ra->seek_req && !ra->abort_request)
+            SDL_CondWait(ra->cond, ra->mutex);
+        ret = ra->seek_req ? AVERROR_EXIT : ra->seek_ret;
+    }
+    
+__exit:
+    SDL_UnlockMutex(ra->mutex);
+    return ret;
+}
+
+int readAhead_open(ReadAhead *ra, const char *url, size_t capacity) {
+    int rc = 0;
+    uint8_t *io_buf = NULL;
+    AVIOInterruptCB int_cb = { __interrupt, ra };
+    
+    memset(ra, 0, sizeof(ReadAhead));
+    ra->size = -1;
+    /* refcounted by libavformat, readAhead_close gives it back */
+    avformat_network_init();
+    
+    /* "-" reads the input from stdin */
+    if (!strcmp(url, "-"))
+        url = "pipe:0";
+    CHECK_ERROR(((rc = avio_open2(&ra->src, url, AVIO_FLAG_READ, &int_cb, NULL)) < 0),
+                "failed to open input for read-ahead",
+                0, __exit)
+    ra->size = avio_size(ra->src);
+    
+    ra->capacity = FFMAX(capacity, 2 * READ_AHEAD_IO_SIZE);
+    CHECK_ERROR(!(ra->buf = av_malloc(ra->capacity)),
+                "failed to allocate read-ahead buffer",
+                AVERROR(ENOMEM),
+                __exit)
+    CHECK_ERROR(!(io_buf = av_malloc(READ_AHEAD_IO_SIZE)),
+                "failed to allocate avio buffer",
+                AVERROR(ENOMEM),
+                __exit)
+    CHECK_ERROR(!(ra->pb = avio_alloc_context(io_buf, READ_AHEAD_IO_SIZE, 0, ra,
+                                              __read_packet, NULL, __seek)),
+                "failed to allocate avio context",
+                AVERROR(ENOMEM),
+                __exit)
+    io_buf = NULL;
+    ra->pb->seekable = ra->src->seekable;
+    
+    ra->mutex = SDL_CreateMutex();
+    ra->cond = SDL_CreateCond();
+    CHECK_ERROR(!(ra->thread = SDL_CreateThread(__reader_thread, "read_ahead", ra)),
+                "failed to create read-ahead thread",
+                AVERROR_UNKNOWN,
+                __exit)
+    
+    av_log(NULL, AV_LOG_VERBOSE,
+           "[demo log] read-ahead: %zu KB ring, source %s, size %lld\n",
+           ra->capacity / 1024,
+           ra->src->seekable ? "seekable" : "not seekable",
+           (long long)ra->size);
+    
+__exit:
+    av_free(io_buf);
+    return rc;
+}
+
+void readAhead_abort(ReadAhead *ra) {
+    if (!ra->mutex) {
+        ra->abort_request = 1;
+        return;
+    }
+    SDL_LockMutex(ra->mutex);
+    ra->abort_request = 1;
+    SDL_CondBroadcast(ra->cond);
+    SDL_UnlockMutex(ra->mutex);
+}
+
+void readAhead_log_stats(ReadAhead *ra) {
+    av_log(NULL, AV_LOG_INFO,
+           "[demo log] read-ahead: %lld bytes read, demuxer stalled %lld times for %.1f ms\n",
+           (long long)ra->bytes_read,
+           (long long)ra->nb_stalls,
+           ra->stall_time / 1000.0);
+}
+
+/* also for a half opened ReadAhead, once per readAhead_open */
+void readAhead_close(ReadAhead *ra) {
+    readAhead_abort(ra);
+    if (ra->thread) {
+        SDL_WaitThread(ra->thread, NULL);
+        ra->thread = NULL;
+    }
+    if (ra->pb) {
+        av_freep(&ra->pb->buffer);
+        avio_context_free(&ra->pb);
+    }
+    if (ra->src) {
+        avio_closep(&ra->src);
+    }
+    av_freep(&ra->buf);
+    if (ra->cond) {
+        SDL_DestroyCond(ra->cond);
+        ra->cond = NULL;
+    }
+    if (ra->mutex) {
+        SDL_DestroyMutex(ra->mutex);
+        ra->mutex = NULL;
+    }
+    avformat_network_deinit();
+}
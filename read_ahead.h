@@ -0,0 +1,59 @@
+//
+//  read_ahead.h
+//  ffmpeg_proj
+//
+//  Created by HorsonChan on 2026/10/17.
+//
+
+#ifndef read_ahead_h
+#define read_ahead_h
+
+#include <stdio.h>
+#include <stdint.h>
+#include <libavformat/avformat.h>
+#include <SDL.h>
+#include "pipeline_stats.h"
+
+/* block size of the source reads, and of the avio buffer the demuxer reads through */
+#define READ_AHEAD_IO_SIZE (64 * 1024)
+
+/*
+ * an AVIOContext in front of the real protocol (file, pipe, http, rtmp ...).
+ * a reader thread keeps pulling the source into a ring, the demuxer's reads
+ * are served from memory, so a disk or network hiccup only costs us once
+ * the ring has run dry. a seek outside the buffered bytes is handed to the
+ * reader thread, the source is only ever touched from there.
+ */
+typedef struct ReadAhead {
+    AVIOContext *src;           /* reader thread private after open */
+    AVIOContext *pb;            /* what avformat reads from */
+    SDL_Thread *thread;
+    
+    SDL_mutex *mutex;
+    SDL_cond *cond;
+    uint8_t *buf;
+    size_t capacity;
+    int64_t head, tail;         /* bytes read from / written to buf, ever */
+    int64_t pos;                /* source offset of the byte at head */
+    int64_t size;               /* source size, < 0 if unknown */
+    int eof;
+    int error;
+    int abort_request;
+    
+    /* seek for the reader thread, it answers with seek_ret and clears seek_req */
+    int seek_req;
+    int64_t seek_pos;
+    int64_t seek_ret;
+    
+    /* demuxer found the ring empty */
+    int64_t nb_stalls;
+    int64_t stall_time;         /* microseconds */
+    int64_t bytes_read;
+    LatencyHistogram *stall;
+} ReadAhead;
+
+int readAhead_open(ReadAhead *ra, const char *url, size_t capacity);
+void readAhead_abort(ReadAhead *ra);
+void readAhead_log_stats(ReadAhead *ra);
+void readAhead_close(ReadAhead *ra);
+#endif /* read_ahead_h */
@@ -0,0 +1,270 @@
+//
+//  recorder.c
+//  ffmpeg_proj
+//
+//  Created by HorsonChan on 2026/10/17.
+//
+
+#include "recorder.h"
+#include "common.h"
+#include <libavutil/time.h>
+
+/* writer thread: rebase onto the end of the file after a seek, then hand it to the muxer */
+static int __write_packet(Recorder *r, AVPacket *pkt, int serial) {
+    int in_idx = pkt->stream_index;
+    int out_idx = r->stream_map[in_idx];
+    AVRational in_tb = r->in_time_base[in_idx];
+    int64_t ts = pkt->dts != AV_NOPTS_VALUE ? pkt->dts : pkt->pts;
+    int64_t offset = 0;
+    int size = pkt->size;
+    int rc = 0;
+    
+    /* first packet of a serial is the keyframe recorder_send waited for */
+    if (serial != r->write_serial) {
+        if (ts != AV_NOPTS_VALUE && r->end_ts != AV_NOPTS_VALUE)
+            r->ts_offset = r->end_ts - av_rescale_q(ts, in_tb, AV_TIME_BASE_Q);
+        r->write_serial = serial;
+    }
+    offset = av_rescale_q(r->ts_offset, AV_TIME_BASE_Q, in_tb);
+    if (pkt->pts != AV_NOPTS_VALUE)
+        pkt->pts += offset;
+    if (pkt->dts != AV_NOPTS_VALUE)
+        pkt->dts += offset;
+    if (ts != AV_NOPTS_VALUE)
+        r->end_ts = FFMAX(r->end_ts, av_rescale_q(ts + offset + pkt->duration, in_tb, AV_TIME_BASE_Q));
+    
+    pkt->stream_index = out_idx;
+    pkt->pos = -1;
+    av_packet_rescale_ts(pkt, in_tb, r->oc->streams[out_idx]->time_base);
+    /* audio read just before the keyframe of a seek may overlap, the muxer refuses it */
+    if (pkt->dts != AV_NOPTS_VALUE) {
+        if (r->last_dts[out_idx] != AV_NOPTS_VALUE && pkt->dts <= r->last_dts[out_idx])
+            return 0;
+        r->last_dts[out_idx] = pkt->dts;
+    }
+    
+    if ((rc = av_interleaved_write_frame(r->oc, pkt)) >= 0) {
+        r->nb_packets++;
+        r->bytes_written += size;
+    }
+    return rc;
+}
+
+static int __recorder_thread(void *data) {
+    Recorder *r = (Recorder *)data;
+    RecordEntry *e = NULL;
+    int64_t enqueue_time = 0;
+    int serial = 0;
+    int rc = 0;
+    
+    SDL_LockMutex(r->mutex);
+    while (1) {
+        if (!r->nb_queued) {
+            if (r->finish)
+                break;
+            SDL_CondWait(r->cond, r->mutex);
+            continue;
+        }
+        /* the blank packet stays in its slot for the next reference */
+        e = &r->ring[r->rindex];
+        av_packet_move_ref(r->write_pkt, e->pkt);
+        serial = e->serial;
+        enqueue_time = e->enqueue_time;
+        r->rindex = (r->rindex + 1) % RECORDER_MAX_PACKETS;
+        r->nb_queued--;
+        r->queued_bytes -= r->write_pkt->size;
+        SDL_UnlockMutex(r->mutex);
+    
+        /* after an error the rest is only drained, the demuxer never waits on us */
+        rc = r->error ? 0 : __write_packet(r, r->write_pkt, serial);
+        if (r->lag)
+            latencyHistogram_record(r->lag, av_gettime_relative() - enqueue_time);
+        av_packet_unref(r->write_pkt);
+    
+        SDL_LockMutex(r->mutex);
+        if (rc < 0 && !r->error) {
+            av_log(NULL, AV_LOG_ERROR, "[demo log] recorder: %s, recording stopped\n", av_err2str(rc));
+            r->error = rc;
+        }
+    }
+    SDL_UnlockMutex(r->mutex);
+    return 0;
+}
+
+int recorder_open(Recorder *r, const char *filename, AVFormatContext *ic, const int *streams, int nb_streams) {
+    int rc = 0;
+    AVStream *in = NULL, *out = NULL;
+    
+    memset(r, 0, sizeof(Recorder));
+    r->video_idx = -1;
+    r->serial = r->write_serial = -1;
+    r->end_ts = AV_NOPTS_VALUE;
+    r->nb_in_streams = ic->nb_streams;
+    CHECK_ERROR(!(r->stream_map = av_malloc_array(ic->nb_streams, sizeof(int))) ||
+                !(r->in_time_base = av_malloc_array(ic->nb_streams, sizeof(AVRational))) ||
+                !(r->write_pkt = av_packet_alloc()),
+                "failed to allocate recorder",
+                AVERROR(ENOMEM),
+                __exit)
+    for (int i = 0; i < ic->nb_streams; i++) {
+        r->stream_map[i] = -1;
+        r->in_time_base[i] = ic->streams[i]->time_base;
+    }
+    
+    /* container from the file name */
+    CHECK_ERROR(((rc = avformat_alloc_output_context2(&r->oc, NULL, NULL, filename)) < 0),
+                "failed to find a container for the recording",
+                0, __exit)
+    for (int i = 0; i < nb_streams; i++) {
+        in = ic->streams[streams[i]];
+        CHECK_ERROR(!(out = avformat_new_stream(r->oc, NULL)),
+                    "failed to add recording stream",
+                    AVERROR(ENOMEM),
+                    __exit)
+        CHECK_ERROR(((rc = avcodec_parameters_copy(out->codecpar, in->codecpar)) < 0),
+                    "failed to copy stream parameters",
+                    0, __exit)
+        /* the input container's tag may mean something else in the output one */
+        out->codecpar->codec_tag = 0;
+        out->time_base = in->time_base;
+        r->stream_map[streams[i]] = out->index;
+        if (in->codecpar->codec_type == AVMEDIA_TYPE_VIDEO && r->video_idx < 0)
+            r->video_idx = streams[i];
+    }
+    CHECK_ERROR(!(r->last_dts = av_malloc_array(r->oc->nb_streams, sizeof(int64_t))),
+                "failed to allocate recorder",
+                AVERROR(ENOMEM),
+                __exit)
+    for (int i = 0; i < r->oc->nb_streams; i++)
+        r->last_dts[i] = AV_NOPTS_VALUE;
+    /* a decodable file starts with a picture */
+    r->need_keyframe = r->video_idx >= 0;
+    
+    if (!(r->oc->oformat->flags & AVFMT_NOFILE)) {
+        CHECK_ERROR(((rc = avio_open(&r->oc->pb, filename, AVIO_FLAG_WRITE)) < 0),
+                    "failed to open recording file",
+                    0, __exit)
+    }
+    CHECK_ERROR(((rc = avformat_write_header(r->oc, NULL)) < 0),
+                "failed to write recording header",
+                0, __exit)
+    r->header_written = 1;
+    
+    r->mutex = SDL_CreateMutex();
+    r->cond = SDL_CreateCond();
+    CHECK_ERROR(!(r->thread = SDL_CreateThread(__recorder_thread, "recorder", r)),
+                "failed to create recorder thread",
+                AVERROR_UNKNOWN,
+                __exit)
+    
+    av_log(NULL, AV_LOG_INFO,
+           "[demo log] recording %d streams to %s (%s)\n",
+           nb_streams,
+           filename,
+           r->oc->oformat->name);
+    
+__exit:
+    return rc;
+}
+
+void recorder_send(Recorder *r, const AVPacket *pkt, int serial) {
+    RecordEntry *e = NULL;
+    int is_video = pkt->stream_index == r->video_idx;
+    
+    if (pkt->stream_index >= r->nb_in_streams || r->stream_map[pkt->stream_index] < 0)
+        return;
+    if (serial != r->serial) {
+        r->serial = serial;
+        r->need_keyframe = r->video_idx >= 0;
+    }
+    /* nothing until the picture can be decoded again, audio ahead of it would be out of step */
+    if (r->need_keyframe) {
+        if (!is_video || !(pkt->flags & AV_PKT_FLAG_KEY)) {
+            if (r->need_keyframe == 2) {
+                r->nb_dropped++;
+                r->bytes_dropped += pkt->size;
+            }
+            return;
+        }
+        r->need_keyframe = 0;
+    }
+    
+    SDL_LockMutex(r->mutex);
+    e = &r->ring[r->windex];
+    if (r->error ||
+        r->nb_queued == RECORDER_MAX_PACKETS ||
+        r->queued_bytes + pkt->size > RECORDER_MAX_BYTES ||
+        (!e->pkt && !(e->pkt = av_packet_alloc())) ||
+        /* a reference to the demuxer's buffer, no copy */
+        av_packet_ref(e->pkt, pkt) < 0) {
+        SDL_UnlockMutex(r->mutex);
+        /* disk too slow: lose recording, never playback */
+        r->nb_dropped++;
+        r->bytes_dropped += pkt->size;
+        if (r->video_idx >= 0)
+            r->need_keyframe = 2;
+        return;
+    }
+    e->serial = serial;
+    e->enqueue_time = av_gettime_relative();
+    r->windex = (r->windex + 1) % RECORDER_MAX_PACKETS;
+    r->nb_queued++;
+    r->queued_bytes += pkt->size;
+    SDL_CondSignal(r->cond);
+    SDL_UnlockMutex(r->mutex);
+}
+
+int recorder_close(Recorder *r) {
+    int rc = 0, ret = 0;
+    
+    if (r->mutex) {
+        SDL_LockMutex(r->mutex);
+        r->finish = 1;
+        SDL_CondSignal(r->cond);
+        SDL_UnlockMutex(r->mutex);
+    }
+    if (r->thread) {
+        SDL_WaitThread(r->thread, NULL);
+        r->thread = NULL;
+    }
+    rc = r->error;
+    
+    if (r->oc) {
+        if (r->header_written) {
+            if ((ret = av_write_trailer(r->oc)) < 0 && !rc)
+                rc = ret;
+            av_log(NULL, AV_LOG_INFO,
+                   "[demo log] recorder: %lld packets, %lld bytes written, %lld packets dropped (%lld bytes)%s\n",
+                   (long long)r->nb_packets,
+                   (long long)r->bytes_written,
+                   (long long)r->nb_dropped,
+                   (long long)r->bytes_dropped,
+                   rc < 0 ? ", failed" : "");
+        }
+        if (!(r->oc->oformat->flags & AVFMT_NOFILE))
+            avio_closep(&r->oc->pb);
+        avformat_free_context(r->oc);
+        r->oc = NULL;
+    }
+    
+    for (int i = 0; i < RECORDER_MAX_PACKETS; i++) {
+        if (r->ring[i].pkt)
+            av_packet_free(&r->ring[i].pkt);
+    }
+    r->nb_queued = 0;
+    r->queued_bytes = 0;
+    av_packet_free(&r->write_pkt);
+    av_freep(&r->stream_map);
+    av_freep(&r->in_time_base);
+    av_freep(&r->last_dts);
+    
+    if (r->cond) {
+        SDL_DestroyCond(r->cond);
+        r->cond = NULL;
+    }
+    if (r->mutex) {
+        SDL_DestroyMutex(r->mutex);
+        r->mutex = NULL;
+    }
+    return rc;
+}
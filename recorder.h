@@ -0,0 +1,77 @@
+//
+//  recorder.h
+//  ffmpeg_proj
+//
+//  Created by HorsonChan on 2026/10/17.
+//
+
+#ifndef recorder_h
+#define recorder_h
+
+#include <stdio.h>
+#include <stdint.h>
+#include <libavformat/avformat.h>
+#include <SDL.h>
+#include "pipeline_stats.h"
+
+/* what may wait for the disk before packets are dropped */
+#define RECORDER_MAX_PACKETS 1024
+#define RECORDER_MAX_BYTES (32 * 1024 * 1024)
+
+typedef struct RecordEntry {
+    AVPacket *pkt;
+    int serial;
+    int64_t enqueue_time;       /* monotonic microseconds */
+} RecordEntry;
+
+/*
+ * stream copy of the demuxed packets into a container of its own (mp4, mkv,
+ * ts ... by file name). the demuxer hands over a reference, never a copy, and
+ * never waits: once the queue is full packets are dropped, the video stream
+ * picks up again at the next keyframe. a seek carries the timestamps on from
+ * where the recording got to, the file holds what was played back to back.
+ */
+typedef struct Recorder {
+    AVFormatContext *oc;
+    int nb_in_streams;
+    int *stream_map;            /* input stream -> output stream, -1 not recorded */
+    AVRational *in_time_base;   /* per input stream */
+    int video_idx;              /* input index, -1 without video */
+    SDL_Thread *thread;
+    
+    SDL_mutex *mutex;
+    SDL_cond *cond;
+    RecordEntry ring[RECORDER_MAX_PACKETS];
+    int rindex, windex, nb_queued;
+    int64_t queued_bytes;
+    int finish;                 /* write what is queued, then the trailer */
+    int header_written;
+    
+    /* demux side */
+    int need_keyframe;          /* 1 at the start and after a seek, 2 after a drop: skipped packets count as dropped */
+    int serial;
+    
+    /* writer thread */
+    AVPacket *write_pkt;
+    int write_serial;
+    int64_t ts_offset;          /* AV_TIME_BASE, added to everything of write_serial */
+    int64_t end_ts;             /* AV_TIME_BASE, end of what is written so far */
+    int64_t *last_dts;          /* per output stream, output time base */
+    int error;
+    
+    int64_t nb_packets;
+    int64_t bytes_written;
+    int64_t nb_dropped;
+    int64_t bytes_dropped;
+    LatencyHistogram *lag;      /* optional, read -> written */
+} Recorder;
+
+/* streams lists the nb_streams input streams to record */
+int recorder_open(Recorder *r, const char *filename, AVFormatContext *ic, const int *streams, int nb_streams);
+
+/* demux side, never blocks: queues a reference to pkt or drops it */
+void recorder_send(Recorder *r, const AVPacket *pkt, int serial);
+
+/* writes out the queue and the trailer, also for a half opened recorder */
+int recorder_close(Recorder *r);
+#endif /* recorder_h */
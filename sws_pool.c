@@ -0,0 +1,268 @@
+//
+//  sws_pool.c
+//  ffmpeg_proj
+//
+//  Created by HorsonChan on 2026/10/17.
+//
+
+#include "sws_pool.h"
+#include "common.h"
+#include <libavutil/time.h>
+
+/* point every plane at row y, chroma planes are shifted by the vertical subsampling */
+static void __slice_planes(const AVPixFmtDescriptor *desc,
+                           uint8_t *const data[],
+                           const int linesize[],
+                           int y,
+                           uint8_t *planes[4]) {
+    for (int p = 0; p < 4; p++) {
+        int shift = (p == 1 || p == 2) ? desc->log2_chroma_h : 0;
+        planes[p] = data[p] ? data[p] + (y >> shift) * linesize[p] : NULL;
+    }
+}
+
+static int __build_slices(SwsPool *pool, AVFrame *src, AVFrame *dst, int flags) {
+    int nb_slices = pool->nb_threads;
+    int vertical_scale = 0;
+    
+    if (pool->nb_slices &&
+        pool->src_w == src->width && pool->src_h == src->height && pool->src_fmt == src->format &&
+        pool->dst_w == dst->width && pool->dst_h == dst->height && pool->dst_fmt == dst->format &&
+        pool->flags == flags) {
+        return 0;
+    }
+    
+    pool->src_desc = av_pix_fmt_desc_get(src->format);
+    pool->dst_desc = av_pix_fmt_desc_get(dst->format);
+    if (!pool->src_desc || !pool->dst_desc) {
+        av_log(NULL, AV_LOG_ERROR, "[demo log] unknown pixel format for sws slices\n");
+        return AVERROR(EINVAL);
+    }
+    
+    /*
+     * paletted input can not be cut, tiny frames are not worth it. neither can
+     * a vertical scale, of the picture or only its chroma (4:2:2 -> 4:2:0):
+     * every slice would round its own factor and filter without the rows of
+     * its neighbours, seams show at the cuts
+     */
+    vertical_scale = src->height != dst->height ||
+                     pool->src_desc->log2_chroma_h != pool->dst_desc->log2_chroma_h;
+    if (pool->src_desc->flags & AV_PIX_FMT_FLAG_PAL ||
+        vertical_scale ||
+        src->height < nb_slices * SWS_POOL_SLICE_ALIGN ||
+        dst->height < nb_slices * SWS_POOL_SLICE_ALIGN) {
+        nb_slices = 1;
+    }
+    
+    for (int i = 0; i < nb_slices; i++) {
+        SwsSlice *slice = &pool->slices[i];
+        int src_y = (src->height * i / nb_slices) & ~(SWS_POOL_SLICE_ALIGN - 1);
+        int src_end = i == nb_slices - 1 ? src->height :
+                      (src->height * (i + 1) / nb_slices) & ~(SWS_POOL_SLICE_ALIGN - 1);
+        int dst_y = (int)((int64_t)src_y * dst->height / src->height) & ~1;
+        int dst_end = i == nb_slices - 1 ? dst->height :
+                      (int)((int64_t)src_end * dst->height / src->height) & ~1;
+        
+        slice->src_y = src_y;
+        slice->src_h = src_end - src_y;
+        slice->dst_y = dst_y;
+        slice->dst_h = dst_end - dst_y;
+        
+        if (!(slice->ctx = sws_getCachedContext(slice->ctx,
+                                                src->width, slice->src_h, src->format,
+                                                dst->width, slice->dst_h, dst->format,
+                                                flags, NULL, NULL, NULL))) {
+            av_log(NULL, AV_LOG_ERROR, "[demo log] failed to create swscontext for slice %d\n", i);
+            pool->nb_slices = 0;
+            return AVERROR_UNKNOWN;
+        }
+    }
+    
+    if (vertical_scale && pool->nb_threads > 1) {
+        av_log(NULL, AV_LOG_VERBOSE,
+               "[demo log] sws pool: %s %dx%d -> %s %dx%d scales vertically, one slice, %d workers idle\n",
+               pool->src_desc->name, src->width, src->height,
+               pool->dst_desc->name, dst->width, dst->height,
+               pool->nb_threads - 1);
+    }
+    pool->nb_slices = nb_slices;
+    pool->src_w = src->width;
+    pool->src_h = src->height;
+    pool->src_fmt = src->format;
+    pool->dst_w = dst->width;
+    pool->dst_h = dst->height;
+    pool->dst_fmt = dst->format;
+    pool->flags = flags;
+    return 0;
+}
+
+static void __convert_slice(SwsPool *pool, SwsSlice *slice) {
+    uint8_t *src_planes[4], *dst_planes[4];
+    
+    __slice_planes(pool->src_desc, pool->src->data, pool->src->linesize, slice->src_y, src_planes);
+    __slice_planes(pool->dst_desc, pool->dst->data, pool->dst->linesize, slice->dst_y, dst_planes);
+    
+    sws_scale(slice->ctx,
+              (const uint8_t *const *)src_planes,
+              pool->src->linesize,
+              0,
+              slice->src_h,
+              dst_planes,
+              pool->dst->linesize);
+}
+
+static int __worker_thread(void *data) {
+    SwsPoolWorker *worker = (SwsPoolWorker *)data;
+    SwsPool *pool = worker->pool;
+    int last_job = 0;
+    
+    while (1) {
+        SDL_LockMutex(pool->mutex);
+        while (!pool->quit && pool->job_id == last_job)
+            SDL_CondWait(pool->job_cond, pool->mutex);
+        if (pool->quit) {
+            SDL_UnlockMutex(pool->mutex);
+            break;
+        }
+        last_job = pool->job_id;
+        SDL_UnlockMutex(pool->mutex);
+        
+        double cpu_start = thread_cpu_time();
+        if (worker->idx < pool->nb_slices) {
+            __convert_slice(pool, &pool->slices[worker->idx]);
+        }
+        
+        SDL_LockMutex(pool->mutex);
+        pool->cpu_time += thread_cpu_time() - cpu_start;
+        if (--pool->pending == 0) {
+            /* last slice out finishes the job */
+            int64_t convert_time = av_gettime_relative() - pool->start_time;
+            pool->nb_frames++;
+            if (pool->nb_slices == 1 && pool->nb_threads > 1)
+                pool->nb_serial_frames++;
+            pool->total_time += convert_time;
+            if (convert_time > pool->max_time)
+                pool->max_time = convert_time;
+            av_log(NULL, AV_LOG_DEBUG,
+                   "[demo log] sws convert %d slices in %.3f ms\n",
+                   pool->nb_slices, convert_time / 1000.0);
+            
+            av_frame_unref(pool->src);
+            if (pool->done_cb)
+                pool->done_cb(pool->opaque, convert_time);
+            SDL_CondBroadcast(pool->done_cond);
+        }
+        SDL_UnlockMutex(pool->mutex);
+    }
+    return 0;
+}
+
+int swsPool_init(SwsPool *pool, int nb_threads) {
+    memset(pool, 0, sizeof(SwsPool));
+    
+    pool->nb_threads = nb_threads < 1 ? 1 :
+                       nb_threads > SWS_POOL_MAX_THREADS ? SWS_POOL_MAX_THREADS : nb_threads;
+    pool->src_fmt = pool->dst_fmt = AV_PIX_FMT_NONE;
+    pool->mutex = SDL_CreateMutex();
+    pool->job_cond = SDL_CreateCond();
+    pool->done_cond = SDL_CreateCond();
+    if (!(pool->src = av_frame_alloc())) {
+        return AVERROR(ENOMEM);
+    }
+    
+    for (int i = 0; i < pool->nb_threads; i++) {
+        pool->workers[i].pool = pool;
+        pool->workers[i].idx = i;
+        if (!(pool->threads[i] = SDL_CreateThread(__worker_thread,
+                                                  "sws_thread",
+                                                  &pool->workers[i]))) {
+            av_log(NULL, AV_LOG_ERROR, "[demo log] failed to create sws thread\n");
+            pool->nb_threads = i;
+            return AVERROR_UNKNOWN;
+        }
+    }
+    return 0;
+}
+
+void swsPool_wait(SwsPool *pool) {
+    SDL_LockMutex(pool->mutex);
+    while (pool->pending > 0)
+        SDL_CondWait(pool->done_cond, pool->mutex);
+    SDL_UnlockMutex(pool->mutex);
+}
+
+int swsPool_submit(SwsPool *pool,
+                   AVFrame *src,
+                   AVFrame *dst,
+                   int flags,
+                   SwsPoolDoneCallback done_cb,
+                   void *opaque) {
+    int rc = 0;
+    
+    /* one frame in flight keeps the output in decode order */
+    swsPool_wait(pool);
+    
+    if ((rc = __build_slices(pool, src, dst, flags)) < 0)
+        return rc;
+    
+    SDL_LockMutex(pool->mutex);
+    av_frame_move_ref(pool->src, src);
+    pool->dst = dst;
+    pool->done_cb = done_cb;
+    pool->opaque = opaque;
+    pool->start_time = av_gettime_relative();
+    pool->pending = pool->nb_threads;
+    pool->job_id++;
+    SDL_CondBroadcast(pool->job_cond);
+    SDL_UnlockMutex(pool->mutex);
+    
+    return rc;
+}
+
+void swsPool_destory(SwsPool *pool) {
+    if (pool->mutex) {
+        SDL_LockMutex(pool->mutex);
+        pool->quit = 1;
+        SDL_CondBroadcast(pool->job_cond);
+        SDL_UnlockMutex(pool->mutex);
+    }
+    
+    for (int i = 0; i < pool->nb_threads; i++) {
+        if (pool->threads[i]) {
+            SDL_WaitThread(pool->threads[i], NULL);
+            pool->threads[i] = NULL;
+        }
+    }
+    
+    if (pool->nb_frames) {
+        av_log(NULL, AV_LOG_INFO,
+               "[demo log] sws pool: %d threads, %lld frames (%lld on one slice), avg %.3f ms, max %.3f ms per frame\n",
+               pool->nb_threads,
+               (long long)pool->nb_frames,
+               (long long)pool->nb_serial_frames,
+               pool->total_time / 1000.0 / pool->nb_frames,
+               pool->max_time / 1000.0);
+    }
+    
+    for (int i = 0; i < SWS_POOL_MAX_THREADS; i++) {
+        if (pool->slices[i].ctx) {
+            sws_freeContext(pool->slices[i].ctx);
+            pool->slices[i].ctx = NULL;
+        }
+    }
+    if (pool->src) {
+        av_frame_free(&pool->src);
+    }
+    if (pool->mutex) {
+        SDL_DestroyMutex(pool->mutex);
+        pool->mutex = NULL;
+    }
+    if (pool->job_cond) {
+        SDL_DestroyCond(pool->job_cond);
+        pool->job_cond = NULL;
+    }
+    if (pool->done_cond) {
+        SDL_DestroyCond(pool->done_cond);
+        pool->done_cond = NULL;
+    }
+}
@@ -0,0 +1,91 @@
+//
+//  sws_pool.h
+//  ffmpeg_proj
+//
+//  Created by HorsonChan on 2026/10/17.
+//
+
+#ifndef sws_pool_h
+#define sws_pool_h
+
+#include <stdio.h>
+#include <SDL.h>
+#include <libavutil/frame.h>
+#include <libavutil/pixdesc.h>
+#include <libswscale/swscale.h>
+
+#define SWS_POOL_MAX_THREADS 16
+/* slice heights are kept a multiple of this so chroma rows never straddle a seam */
+#define SWS_POOL_SLICE_ALIGN 16
+
+typedef void (*SwsPoolDoneCallback)(void *opaque, int64_t convert_time);
+
+struct SwsPool;
+
+typedef struct SwsPoolWorker {
+    struct SwsPool *pool;
+    int idx;
+} SwsPoolWorker;
+
+typedef struct SwsSlice {
+    struct SwsContext *ctx;
+    int src_y, src_h;
+    int dst_y, dst_h;
+} SwsSlice;
+
+/*
+ * converts one frame at a time, split in horizontal slices with one SwsContext
+ * and one worker each; the caller keeps decoding while a frame is in flight
+ */
+typedef struct SwsPool {
+    int nb_threads;
+    SDL_Thread *threads[SWS_POOL_MAX_THREADS];
+    SwsPoolWorker workers[SWS_POOL_MAX_THREADS];
+    SwsSlice slices[SWS_POOL_MAX_THREADS];
+    int nb_slices;
+    
+    /* geometry the slice contexts were built for */
+    int src_w, src_h, src_fmt;
+    int dst_w, dst_h, dst_fmt;
+    int flags;
+    const AVPixFmtDescriptor *src_desc;
+    const AVPixFmtDescriptor *dst_desc;
+    
+    /* current job */
+    AVFrame *src;
+    AVFrame *dst;
+    int job_id;
+    int pending;
+    int64_t start_time;
+    SwsPoolDoneCallback done_cb;
+    void *opaque;
+    
+    int quit;
+    SDL_mutex *mutex;
+    SDL_cond *job_cond;
+    SDL_cond *done_cond;
+    
+    /* conversion time statistics, in microseconds */
+    int64_t nb_frames;
+    int64_t nb_serial_frames;   /* one slice, the other workers idle (vertical scale, tiny, paletted) */
+    int64_t total_time;
+    int64_t max_time;
+    double cpu_time;            /* seconds, summed over all workers */
+} SwsPool;
+
+int swsPool_init(SwsPool *pool, int nb_threads);
+
+/* waits for the previous job, then takes over src's reference and converts it into dst */
+int swsPool_submit(SwsPool *pool,
+                   AVFrame *src,
+                   AVFrame *dst,
+                   int flags,
+                   SwsPoolDoneCallback done_cb,
+                   void *opaque);
+
+/* block until no job is in flight */
+void swsPool_wait(SwsPool *pool);
+
+void swsPool_destory(SwsPool *pool);
+
+#endif /* sws_pool_h */
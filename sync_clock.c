@@ -0,0 +1,108 @@
+//
+//  sync_clock.c
+//  ffmpeg_proj
+//
+//  Created by HorsonChan on 2026/10/17.
+//
+
+#include "sync_clock.h"
+#include <math.h>
+#include <libavutil/time.h>
+
+typedef struct ClockSnapshot {
+    double pts_drift;
+    double last_updated;
+    double speed;
+    int serial;
+} ClockSnapshot;
+
+static void __read(SyncClock *c, ClockSnapshot *s) {
+    unsigned seq0 = 0, seq1 = 0;
+    
+    do {
+        seq0 = atomic_load_explicit(&c->seq, memory_order_acquire);
+        s->pts_drift = atomic_load_explicit(&c->pts_drift, memory_order_relaxed);
+        s->last_updated = atomic_load_explicit(&c->last_updated, memory_order_relaxed);
+        s->speed = atomic_load_explicit(&c->speed, memory_order_relaxed);
+        s->serial = atomic_load_explicit(&c->serial, memory_order_relaxed);
+        atomic_thread_fence(memory_order_acquire);
+        seq1 = atomic_load_explicit(&c->seq, memory_order_relaxed);
+    } while ((seq0 & 1) || seq0 != seq1);
+}
+
+static void __write_begin(SyncClock *c) {
+    atomic_store_explicit(&c->seq, atomic_load_explicit(&c->seq, memory_order_relaxed) + 1,
+                          memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+}
+
+static void __write_end(SyncClock *c) {
+    atomic_store_explicit(&c->seq, atomic_load_explicit(&c->seq, memory_order_relaxed) + 1,
+                          memory_order_release);
+}
+
+double syncClock_now(void) {
+    return av_gettime_relative() / 1000000.0;
+}
+
+void syncClock_init(SyncClock *c) {
+    atomic_init(&c->seq, 0);
+    atomic_init(&c->pts_drift, NAN);
+    atomic_init(&c->last_updated, syncClock_now());
+    atomic_init(&c->speed, 1.0);
+    atomic_init(&c->serial, -1);
+}
+
+void syncClock_set_at(SyncClock *c, double pts, int serial, double time) {
+    __write_begin(c);
+    atomic_store_explicit(&c->pts_drift, pts - time, memory_order_relaxed);
+    atomic_store_explicit(&c->last_updated, time, memory_order_relaxed);
+    atomic_store_explicit(&c->serial, serial, memory_order_relaxed);
+    __write_end(c);
+}
+
+void syncClock_set(SyncClock *c, double pts, int serial) {
+    syncClock_set_at(c, pts, serial, syncClock_now());
+}
+
+/* rebase first, so the clock does not jump when the speed changes */
+void syncClock_set_speed(SyncClock *c, double speed) {
+    ClockSnapshot s;
+    double now = syncClock_now();
+    
+    __read(c, &s);
+    __write_begin(c);
+    if (!isnan(s.pts_drift)) {
+        double pts = s.pts_drift + now - (now - s.last_updated) * (1.0 - s.speed);
+        atomic_store_explicit(&c->pts_drift, pts - now, memory_order_relaxed);
+        atomic_store_explicit(&c->last_updated, now, memory_order_relaxed);
+    }
+    atomic_store_explicit(&c->speed, speed, memory_order_relaxed);
+    __write_end(c);
+}
+
+double syncClock_get(SyncClock *c) {
+    ClockSnapshot s;
+    double now = syncClock_now();
+    
+    __read(c, &s);
+    if (isnan(s.pts_drift))
+        return NAN;
+    return s.pts_drift + now - (now - s.last_updated) * (1.0 - s.speed);
+}
+
+int syncClock_serial(SyncClock *c) {
+    return atomic_load(&c->serial);
+}
+
+void syncClock_sync_to_slave(SyncClock *c, SyncClock *slave, double threshold) {
+    double clock = syncClock_get(c);
+    double slave_clock = syncClock_get(slave);
+    
+    if (isnan(slave_clock))
+        return;
+    if (isnan(clock) ||
+        syncClock_serial(c) != syncClock_serial(slave) ||
+        fabs(clock - slave_clock) > threshold)
+        syncClock_set(c, slave_clock, syncClock_serial(slave));
+}
@@ -0,0 +1,40 @@
+//
+//  sync_clock.h
+//  ffmpeg_proj
+//
+//  Created by HorsonChan on 2026/10/17.
+//
+
+#ifndef sync_clock_h
+#define sync_clock_h
+
+#include <stdio.h>
+#include <stdatomic.h>
+
+/*
+ * a media clock sampled against the system clock: it stores pts - time at
+ * the last update and runs on from there. one thread writes a clock, any
+ * thread reads it lock free; the fields sit behind a sequence counter and
+ * a reader retries if a write slipped in while it was copying them.
+ */
+typedef struct SyncClock {
+    atomic_uint seq;                /* odd while an update is in progress */
+    _Atomic double pts_drift;       /* pts - last_updated */
+    _Atomic double last_updated;    /* system time, seconds */
+    _Atomic double speed;
+    atomic_int serial;              /* seek serial of the pts, -1 before the first set */
+} SyncClock;
+
+/* monotonic system time all clocks are sampled against, seconds */
+double syncClock_now(void);
+
+void syncClock_init(SyncClock *c);
+void syncClock_set_at(SyncClock *c, double pts, int serial, double time);
+void syncClock_set(SyncClock *c, double pts, int serial);
+void syncClock_set_speed(SyncClock *c, double speed);
+/* NAN until the clock was set once */
+double syncClock_get(SyncClock *c);
+int syncClock_serial(SyncClock *c);
+/* follow slave when unset, on another serial or more than threshold away */
+void syncClock_sync_to_slave(SyncClock *c, SyncClock *slave, double threshold);
+#endif /* sync_clock_h */
@@ -8,13 +8,14 @@
 #include "video_info.h"
 
 void videoInfo_init(VideoInfo *info) {
-//AVFrame             audio_frame;
-//AVPacket            audio_pkt;
     memset(info->in_filename, 0, sizeof(info->in_filename));
+    memset(info->record_filename, 0, sizeof(info->record_filename));
     memset(info->audio_buf, 0, sizeof(info->audio_buf));
-    memset(info->video_buf, 0, sizeof(info->video_buf));
     
     info->fmt_ctx = NULL;
+    info->read_ahead = NULL;
+    info->recorder = NULL;
+    playerOptions_init(&info->opts);
     info->has_audio = 0;
     info->has_video = 0;
     info->video_stream_idx = -1;
@@ -23,54 +24,206 @@ void videoInfo_init(VideoInfo *info) {
     //audio
     info->a_st = NULL;
     info->a_c = NULL;
-    info->audio_pos = NULL;
-    info->audio_end = NULL;
+    info->audio_frame = NULL;
+    info->audio_dev = 0;
+    info->pcm_ring = NULL;
+    info->audio_mix_buf = NULL;
+    info->audio_mix_size = 0;
     info->swr_ctx = NULL;
-    info->audio_clock = 0.0;
+    memset(&info->audio_src, 0, sizeof(info->audio_src));
+    memset(&info->audio_tgt, 0, sizeof(info->audio_tgt));
+    memset(&info->audio_spec, 0, sizeof(info->audio_spec));
+    info->audio_src.fmt = info->audio_tgt.fmt = AV_SAMPLE_FMT_NONE;
+    info->audio_decode_clock = 0.0;
+    info->audio_serial = 0;
+    info->audio_skip_until = 0.0;
     info->audio_data_size_ps = 0.0;
+    info->audio_opened = 0;
+    info->audio_started = 0;
     
     //video
     info->v_st = NULL;
     info->v_c = NULL;
-    info->sws_ctx = NULL;
+    info->sws_pool = NULL;
+    framePool_init(&info->picture_pool, 0);
+    atomic_init(&info->output_width, 0);
+    atomic_init(&info->output_height, 0);
     info->v_frame = NULL;
+    info->video_buf = NULL;
+    info->video_buf_max = info->video_buf_depth = info->video_buf_allocated = 0;
     info->video_buf_size = info->video_buf_ridx = info->video_buf_widx = 0;
+    info->produce_time_avg = info->produce_time_var = 0.0;
+    info->depth_shrink_count = 0;
+    info->late_ratio = 0.0;
+    info->skip_level = info->skip_calm_count = 0;
+    info->nb_frames_dropped_early = info->nb_frames_dropped_late = 0;
+    info->nb_skip_packets = info->nb_skip_frames = 0;
     info->refresh_time = 0.0;
+    info->frame_timer = 0;
+    info->present_waiting = 0;
     info->last_frame_pts = 0.0;
     info->last_frame_delay = 0.0;
     info->video_clock = 0.0;
+    info->video_decode_latency = 0.0;
     
     info->p_mutex = SDL_CreateMutex();
     info->p_cond = SDL_CreateCond();
+    
+    syncClock_init(&info->audclk);
+    syncClock_init(&info->vidclk);
+    syncClock_init(&info->extclk);
+    info->audio_diff_cum = 0.0;
+    info->audio_diff_avg_coef = 0.0;
+    info->audio_diff_threshold = 0.0;
+    info->audio_diff_avg_count = 0;
+    
+    keyframeIndex_init(&info->keyframes);
+    info->seek_req = 0;
+    info->seek_pos = 0;
+    info->seek_serial = 0;
+    info->seek_target = 0.0;
+    info->seek_start_time = 0;
+    info->trick_speed = info->seek_speed = info->stream_speed = 0.0;
+    info->trick_last = info->trick_next = AV_NOPTS_VALUE;
+    info->trick_seek = info->trick_start = 0;
+    
+    info->startup_time = 0;
+    info->first_frame_time = 0;
+    info->nb_frames_presented = 0;
+    atomic_init(&info->first_audio_time, 0);
+    info->first_audio_reported = 0;
+    
     info->demux_t = NULL;
     info->decode_t = NULL;
+    info->audio_t = NULL;
+    info->executor = NULL;
+    info->demux_task = info->decode_task = NULL;
+    info->demux_pkt = info->video_pkt = NULL;
+    info->demux_pkt_q = NULL;
+    info->demux_pkt_serial = 0;
+    info->video_frame_pending = 0;
+    info->video_dec_serial = info->video_dec_eof = 0;
+    info->video_skip_until = 0.0;
+    info->video_busy_time = 0;
     info->quit = 0;
     info->err_code = 0;
     
+    info->headless = 0;
+    info->demux_eof = info->video_eof = info->audio_eof = 0;
+    info->nb_packets_read = info->bytes_read = 0;
+    info->nb_video_frames = info->nb_audio_frames = 0;
+    info->demux_cpu = info->video_cpu = info->audio_cpu = 0.0;
+    pipelineStats_init(&info->stats);
+    
     info->w_mutex = SDL_CreateMutex();
     info->w_cond = SDL_CreateCond();
     
     info->video_q = malloc(sizeof(PacketQueue));
-    packetQueue_init(info->video_q);
+    packetQueue_init(info->video_q,
+                     MAX_VIDEOQ_SIZE,
+                     MAX_VIDEOQ_PACKETS,
+                     MAX_QUEUE_DURATION);
     
     info->audio_q = malloc(sizeof(PacketQueue));
-    packetQueue_init(info->audio_q);
+    packetQueue_init(info->audio_q,
+                     MAX_AUDIOQ_SIZE,
+                     MAX_AUDIOQ_PACKETS,
+                     MAX_QUEUE_DURATION);
+    
+    info->video_q->latency = &info->stats.video_queue;
+    info->audio_q->latency = &info->stats.audio_queue;
     
     //SDL
     info->window = NULL;
     info->renderer = NULL;
     info->texture = NULL;
+    info->bytes_uploaded = info->nb_uploads = 0;
 }
 
 void videoInfo_destory(VideoInfo *info) {
-    free(info->audio_q);
-    free(info->video_q);
+    /* wake up and join the workers before tearing down what they use */
+    info->quit = 1;
+    if (info->audio_q) {
+        packetQueue_abort(info->audio_q);
+    }
+    if (info->video_q) {
+        packetQueue_abort(info->video_q);
+    }
+    if (info->pcm_ring) {
+        pcmRing_abort(info->pcm_ring);
+    }
+    if (info->read_ahead) {
+        readAhead_abort(info->read_ahead);
+    }
+    if (info->p_mutex) {
+        SDL_LockMutex(info->p_mutex);
+        SDL_CondSignal(info->p_cond);
+        SDL_UnlockMutex(info->p_mutex);
+    }
+    if (info->audio_dev) {
+        SDL_CloseAudioDevice(info->audio_dev);
+        info->audio_dev = 0;
+    }
+    
+    //thread
+    if (info->demux_t) {
+        SDL_WaitThread(info->demux_t, NULL);
+        info->demux_t = NULL;
+    }
+    if (info->decode_t) {
+        SDL_WaitThread(info->decode_t, NULL);
+        info->decode_t = NULL;
+    }
+    if (info->audio_t) {
+        SDL_WaitThread(info->audio_t, NULL);
+        info->audio_t = NULL;
+    }
+    /* created by demux_t, so only once it is joined; woken in case they sit idle */
+    if (info->demux_task) {
+        executor_wake(info->demux_task);
+        executor_task_wait(info->demux_task);
+        executor_task_free(&info->demux_task);
+    }
+    if (info->decode_task) {
+        executor_wake(info->decode_task);
+        executor_task_wait(info->decode_task);
+        executor_task_free(&info->decode_task);
+    }
+    if (info->demux_pkt) {
+        av_packet_free(&info->demux_pkt);
+    }
+    if (info->video_pkt) {
+        av_packet_free(&info->video_pkt);
+    }
+    /* the demuxer is gone, nothing is sent anymore: write out what is queued */
+    if (info->recorder) {
+        recorder_close(info->recorder);
+        free(info->recorder);
+        info->recorder = NULL;
+    }
+    
+    pipelineStats_dump(&info->stats, "stats");
+    if (info->has_video) {
+        av_log(NULL, AV_LOG_INFO,
+               "[demo log] video: %lld frames dropped before conversion, %lld dropped late, ~%lld skipped by the decoder\n",
+               (long long)info->nb_frames_dropped_early,
+               (long long)info->nb_frames_dropped_late,
+               (long long)FFMAX(info->nb_skip_packets - info->nb_skip_frames, 0));
+    }
+    keyframeIndex_destory(&info->keyframes);
     
 //    char                in_filename[1024];
     if (info->fmt_ctx) {
         avformat_close_input(&info->fmt_ctx);
         info->fmt_ctx = NULL;
     }
+    /* custom io, avformat_close_input leaves it to us */
+    if (info->read_ahead) {
+        readAhead_log_stats(info->read_ahead);
+        readAhead_close(info->read_ahead);
+        free(info->read_ahead);
+        info->read_ahead = NULL;
+    }
     
     //audio
     if (info->a_c) {
@@ -81,15 +234,22 @@ void videoInfo_destory(VideoInfo *info) {
         info->a_st = NULL;
     }
     if (info->audio_q) {
+        packetQueue_log_stats(info->audio_q, "audio");
         packetQueue_destory(info->audio_q);
-//        free(info->audio_q);//question: free 函数的意义与实现？
+        free(info->audio_q);
         info->audio_q = NULL;
     }
-    if (info->audio_pos) {
-        info->audio_pos = NULL;
+    if (info->pcm_ring) {
+        pcmRing_log_stats(info->pcm_ring, "audio");
+        pcmRing_destory(info->pcm_ring);
+        free(info->pcm_ring);
+        info->pcm_ring = NULL;
     }
-    if (info->audio_end) {
-        info->audio_end = NULL;
+    if (info->audio_mix_buf) {
+        av_freep(&info->audio_mix_buf);
+    }
+    if (info->audio_frame) {
+        av_frame_free(&info->audio_frame);
     }
     if (info->swr_ctx) {
         swr_free(&info->swr_ctx);
@@ -104,17 +264,31 @@ void videoInfo_destory(VideoInfo *info) {
         info->v_st = NULL;
     }
     if (info->video_q) {
+        packetQueue_log_stats(info->video_q, "video");
         packetQueue_destory(info->video_q);
-//        free(info->video_q);//question: free 函数的意义与实现？
+        free(info->video_q);
         info->video_q = NULL;
     }
-    if (info->sws_ctx) {
-        sws_freeContext(info->sws_ctx);
-        info->sws_ctx = NULL;
+    if (info->sws_pool) {
+        swsPool_destory(info->sws_pool);
+        free(info->sws_pool);
+        info->sws_pool = NULL;
     }
     if (info->v_frame) {
         av_frame_free(&info->v_frame);
     }
+    if (info->video_buf) {
+        for (int i = 0; i < info->video_buf_max; i++) {
+            if (info->video_buf[i]) {
+                av_frame_free(&info->video_buf[i]->frame);
+                free(info->video_buf[i]);
+            }
+        }
+        free(info->video_buf);
+        info->video_buf = NULL;
+    }
+    /* buffers still referenced somewhere go back to it later and are freed then */
+    framePool_destory(&info->picture_pool);
     if (info->p_mutex) {
         SDL_DestroyMutex(info->p_mutex);
         info->p_mutex = NULL;
@@ -124,16 +298,6 @@ void videoInfo_destory(VideoInfo *info) {
         info->p_cond = NULL;
     }
     
-    //thread
-    if (info->demux_t) {
-        SDL_WaitThread(info->demux_t, NULL);
-        info->demux_t = NULL;
-    }
-    if (info->decode_t) {
-        SDL_WaitThread(info->decode_t, NULL);
-        info->decode_t = NULL;
-    }
-    
     if (info->w_mutex) {
         SDL_DestroyMutex(info->w_mutex);
         info->w_mutex = NULL;
@@ -143,10 +307,10 @@ void videoInfo_destory(VideoInfo *info) {
         info->w_cond = NULL;
     }
     
-    //SDL
-    if (info->window) {
-        SDL_DestroyWindow(info->window);
-        info->window = NULL;
+    //SDL, children first: the renderer frees its textures, the window its renderer
+    if (info->texture) {
+        SDL_DestroyTexture(info->texture);
+        info->texture = NULL;
     }
     
     if (info->renderer) {
@@ -154,8 +318,8 @@ void videoInfo_destory(VideoInfo *info) {
         info->renderer = NULL;
     }
     
-    if (info->texture) {
-        SDL_DestroyTexture(info->texture);
-        info->texture = NULL;
+    if (info->window) {
+        SDL_DestroyWindow(info->window);
+        info->window = NULL;
     }
 }
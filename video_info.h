@@ -15,20 +15,56 @@
 #include <libswscale/swscale.h>
 #include <libswresample/swresample.h>
 #include "packet_queue.h"
+#include "pcm_ring.h"
+#include "player_options.h"
+#include "sws_pool.h"
+#include "pipeline_stats.h"
+#include "keyframe_index.h"
+#include "sync_clock.h"
+#include "read_ahead.h"
+#include "executor.h"
+#include "frame_pool.h"
+#include "recorder.h"
 #include <SDL.h>
 
 #define SDL_AUDIO_BUFFER_SIZE 1024
 #define MAX_AUDIO_FRAME_SIZE 192000
-#define VIDEO_PICTURE_QUEUE_SIZE 3
+/* adaptive picture queue never goes below this many pictures */
+#define VIDEO_PICTURE_QUEUE_MIN 2
+
+/* packet queue capacity, demuxer blocks once any of them is reached */
+#define MAX_AUDIOQ_SIZE (1 * 1024 * 1024)
+#define MAX_VIDEOQ_SIZE (16 * 1024 * 1024)
+#define MAX_AUDIOQ_PACKETS 512
+#define MAX_VIDEOQ_PACKETS 256
+#define MAX_QUEUE_DURATION 5.0
+
+/* pcm layout on either side of swr */
+typedef struct AudioParams {
+    int freq;
+    int channels;
+    int64_t channel_layout;
+    enum AVSampleFormat fmt;
+    int frame_size;         /* bytes of one sample in every channel */
+    int bytes_per_sec;
+} AudioParams;
 
 typedef struct FrameInfo {
+    struct VideoInfo *owner;
     AVFrame *frame;
     double pts;
+    int direct;     /* frame is a reference to the decoder output, no sws copy */
+    int64_t ready_time;     /* picture landed in the queue, monotonic microseconds */
+    int serial;             /* seek serial of the packet it was decoded from */
 } FrameInfo;
 
 typedef struct VideoInfo {
     char                in_filename[1024];
     AVFormatContext     *fmt_ctx;
+    ReadAhead           *read_ahead;        /* custom io under fmt_ctx, NULL if avformat opened the input */
+    Recorder            *recorder;          /* -record, fed by the demuxer */
+    char                record_filename[1024];  /* -record numbered per player when there are several */
+    PlayerOptions       opts;
     
     int                 has_audio, has_video;
     int                 video_stream_idx, audio_stream_idx;
@@ -38,37 +74,123 @@ typedef struct VideoInfo {
     AVCodecContext      *a_c;
     PacketQueue         *audio_q;
     uint8_t             audio_buf[(MAX_AUDIO_FRAME_SIZE * 3)];
-    uint8_t             *audio_pos;
-    uint8_t             *audio_end;
-    AVFrame             audio_frame;
-    AVPacket            audio_pkt;
-    SwrContext          *swr_ctx;
-    double              audio_clock;
-    int                 audio_data_size_ps;
+    PcmRing             *pcm_ring;          /* decode thread -> audio callback */
+    uint8_t             *audio_mix_buf;     /* callback scratch, one device buffer */
+    int                 audio_mix_size;     /* bytes of one device buffer */
+    AVFrame             *audio_frame;       /* decode thread private */
+    SDL_AudioDeviceID   audio_dev;          /* 0 while no device is open */
+    SwrContext          *swr_ctx;           /* NULL while decoder output goes to the device as it is */
+    AudioParams         audio_src;          /* decoder output swr_ctx was set up for */
+    AudioParams         audio_tgt;          /* what the device plays */
+    SDL_AudioSpec       audio_spec;         /* obtained from the device */
+    double              audio_decode_clock; /* decode thread private */
+    int                 audio_serial;       /* decode thread private */
+    double              audio_skip_until;   /* accurate seek, drop pcm before this */
+    int                 audio_data_size_ps; /* audio_tgt.bytes_per_sec */
+    int                 audio_opened;
+    int                 audio_started;
     
     //video
     AVStream            *v_st;
     AVCodecContext      *v_c;
     PacketQueue         *video_q;
-    struct SwsContext   *sws_ctx;
+    SwsPool             *sws_pool;
+    FramePool           picture_pool;           /* buffers of converted pictures */
+    atomic_int          output_width;           /* drawable in pixels, pictures are scaled down to it */
+    atomic_int          output_height;          /* main thread writes, decoder reads, 0 headless */
     AVFrame             *v_frame;
-    FrameInfo           *video_buf[VIDEO_PICTURE_QUEUE_SIZE];
+    FrameInfo           **video_buf;            /* ring of video_buf_max slots */
+    int                 video_buf_max;
+    int                 video_buf_depth;        /* pictures allowed in flight, <= video_buf_max */
+    int                 video_buf_allocated;    /* slots holding their own picture buffer */
     int                 video_buf_widx, video_buf_ridx;
     int                 video_buf_size;
+    double              produce_time_avg;       /* decode time per picture, ewma, seconds */
+    double              produce_time_var;
+    int                 depth_shrink_count;
+    /* late picture policy, see frame_is_late and update_decoder_skip */
+    double              late_ratio;
+    int                 skip_level;             /* 1 no loop filter, 2 no non reference frames */
+    int                 skip_calm_count;
+    int64_t             nb_frames_dropped_early;    /* before conversion, decode thread */
+    int64_t             nb_frames_dropped_late;     /* at presentation, main thread */
+    int64_t             nb_skip_packets, nb_skip_frames;    /* in and out while skipping */
     SDL_mutex           *p_mutex;
     SDL_cond            *p_cond;
     double              refresh_time;
+    int64_t             frame_timer;        /* absolute target of the next picture */
+    int                 present_waiting;    /* scheduler sleeps until frame_publish */
     double              last_frame_delay;
     double              last_frame_pts;
     double              video_clock;
+    double              video_decode_latency;   /* extra delay of frame threading */
+    
+    //clocks, one writer each: audclk the audio callback, vidclk and extclk the main thread
+    SyncClock           audclk;
+    SyncClock           vidclk;
+    SyncClock           extclk;
+    /* audio not master: its drift is averaged and stretched away with swr compensation */
+    double              audio_diff_cum;
+    double              audio_diff_avg_coef;
+    double              audio_diff_threshold;
+    int                 audio_diff_avg_count;
+    
+    //seek, requested on the main thread and carried out by the demuxer
+    KeyframeIndex       keyframes;          /* demux thread private */
+    int                 seek_req;
+    int64_t             seek_pos;           /* AV_TIME_BASE */
+    int                 seek_serial;        /* stamped on packets and pictures, see packetQueue_flush */
+    double              seek_target;        /* seconds, decoders drop output before it */
+    int64_t             seek_start_time;    /* request time, 0 once the first picture is up */
+    
+    //trick play, keyframes only; the speed travels with a seek request like seek_pos
+    double              trick_speed;        /* main thread, 0 normal, < 0 rewinds */
+    double              seek_speed;         /* trick_speed of the pending request, w_mutex */
+    double              stream_speed;       /* carried out by the demuxer, decoders read it with the new serial */
+    int64_t             trick_last;         /* demux private from here, v_st time base: keyframe sent last */
+    int64_t             trick_next;         /* where the next one should come from */
+    int                 trick_seek;         /* jump to trick_next before the next read */
+    int                 trick_start;        /* rewound to the first keyframe, nothing left to send */
+    
+    //startup, av_gettime_relative
+    int64_t             startup_time;
+    int64_t             first_frame_time;
+    int64_t             nb_frames_presented;
+    atomic_llong        first_audio_time;   /* first pcm heard, set by the audio callback */
+    int                 first_audio_reported;
     
     //thread
     SDL_Thread          *demux_t;
     SDL_Thread          *decode_t;
+    SDL_Thread          *audio_t;
+    
+    //shared workers, demux and video decode run as tasks instead of demux_t and decode_t
+    Executor            *executor;          /* not ours, NULL for a thread per stage */
+    ExecTask            *demux_task;
+    ExecTask            *decode_task;
+    AVPacket            *demux_pkt;         /* demux task private */
+    PacketQueue         *demux_pkt_q;       /* demux_pkt waits for room in there */
+    int                 demux_pkt_serial;
+    AVPacket            *video_pkt;         /* decode task private, as are the fields below */
+    int                 video_frame_pending;    /* v_frame waits for room in the picture queue */
+    int                 video_dec_serial;
+    int                 video_dec_eof;
+    double              video_skip_until;
+    int64_t             video_busy_time;
     
     int                 quit;
     int                 err_code;
     
+    //benchmark
+    int                 headless;
+    int                 demux_eof, video_eof, audio_eof;
+    int64_t             nb_packets_read;
+    int64_t             bytes_read;
+    int64_t             nb_video_frames;
+    int64_t             nb_audio_frames;
+    double              demux_cpu, video_cpu, audio_cpu;
+    PipelineStats       stats;
+    
     //write mutex
     SDL_mutex           *w_mutex;
     SDL_cond            *w_cond;
@@ -77,6 +199,8 @@ typedef struct VideoInfo {
     SDL_Window          *window;
     SDL_Renderer        *renderer;
     SDL_Texture         *texture;
+    int64_t             bytes_uploaded;     /* into the texture, main thread */
+    int64_t             nb_uploads;
 } VideoInfo;
 
 void videoInfo_init(VideoInfo *info);
@@ -0,0 +1,266 @@
+//
+//  yuv_upload.c
+//  ffmpeg_proj
+//
+//  Created by HorsonChan on 2026/10/17.
+//
+
+#include "yuv_upload.h"
+#include <string.h>
+#include <libavutil/cpu.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define YUV_UPLOAD_X86 1
+#include <immintrin.h>
+#define AVX2_TARGET __attribute__((target("avx2")))
+#else
+#define YUV_UPLOAD_X86 0
+#endif
+
+/* uv uv uv.. -> uu.. vv.. , n pairs */
+typedef void (*DeinterleaveFunc)(const uint8_t *src, uint8_t *u, uint8_t *v, int n);
+/* 16 bit samples >> shift -> 8 bit, n samples */
+typedef void (*PackFunc)(const uint16_t *src, uint8_t *dst, int n, int shift);
+/* both of the above, for p010 chroma */
+typedef void (*Deinterleave16Func)(const uint16_t *src, uint8_t *u, uint8_t *v, int n, int shift);
+
+static DeinterleaveFunc deinterleave_row;
+static PackFunc pack_row;
+static Deinterleave16Func deinterleave16_row;
+static const char *kernel_isa = "c";
+
+static void __deinterleave_c(const uint8_t *src, uint8_t *u, uint8_t *v, int n) {
+    for (int i = 0; i < n; i++) {
+        u[i] = src[2 * i];
+        v[i] = src[2 * i + 1];
+    }
+}
+
+static void __pack_c(const uint16_t *src, uint8_t *dst, int n, int shift) {
+    for (int i = 0; i < n; i++) {
+        dst[i] = src[i] >> shift;
+    }
+}
+
+static void __deinterleave16_c(const uint16_t *src, uint8_t *u, uint8_t *v, int n, int shift) {
+    for (int i = 0; i < n; i++) {
+        u[i] = src[2 * i] >> shift;
+        v[i] = src[2 * i + 1] >> shift;
+    }
+}
+
+#if YUV_UPLOAD_X86
+
+static void __deinterleave_sse2(const uint8_t *src, uint8_t *u, uint8_t *v, int n) {
+    const __m128i mask = _mm_set1_epi16(0x00ff);
+    int i = 0;
+    
+    for (; i + 16 <= n; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(src + 2 * i));
+        __m128i b = _mm_loadu_si128((const __m128i *)(src + 2 * i + 16));
+        _mm_storeu_si128((__m128i *)(u + i),
+                         _mm_packus_epi16(_mm_and_si128(a, mask), _mm_and_si128(b, mask)));
+        _mm_storeu_si128((__m128i *)(v + i),
+                         _mm_packus_epi16(_mm_srli_epi16(a, 8), _mm_srli_epi16(b, 8)));
+    }
+    __deinterleave_c(src + 2 * i, u + i, v + i, n - i);
+}
+
+static void __pack_sse2(const uint16_t *src, uint8_t *dst, int n, int shift) {
+    const __m128i count = _mm_cvtsi32_si128(shift);
+    int i = 0;
+    
+    for (; i + 16 <= n; i += 16) {
+        __m128i a = _mm_srl_epi16(_mm_loadu_si128((const __m128i *)(src + i)), count);
+        __m128i b = _mm_srl_epi16(_mm_loadu_si128((const __m128i *)(src + i + 8)), count);
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_packus_epi16(a, b));
+    }
+    __pack_c(src + i, dst + i, n - i, shift);
+}
+
+static void __deinterleave16_sse2(const uint16_t *src, uint8_t *u, uint8_t *v, int n, int shift) {
+    const __m128i count = _mm_cvtsi32_si128(shift);
+    const __m128i mask = _mm_set1_epi32(0xffff);
+    int i = 0;
+    
+    for (; i + 8 <= n; i += 8) {
+        __m128i a = _mm_srl_epi16(_mm_loadu_si128((const __m128i *)(src + 2 * i)), count);
+        __m128i b = _mm_srl_epi16(_mm_loadu_si128((const __m128i *)(src + 2 * i + 8)), count);
+        /* samples fit in a byte now, so the signed dword -> word pack cannot saturate */
+        __m128i uw = _mm_packs_epi32(_mm_and_si128(a, mask), _mm_and_si128(b, mask));
+        __m128i vw = _mm_packs_epi32(_mm_srli_epi32(a, 16), _mm_srli_epi32(b, 16));
+        _mm_storel_epi64((__m128i *)(u + i), _mm_packus_epi16(uw, uw));
+        _mm_storel_epi64((__m128i *)(v + i), _mm_packus_epi16(vw, vw));
+    }
+    __deinterleave16_c(src + 2 * i, u + i, v + i, n - i, shift);
+}
+
+/* packs work per 128 bit lane, 0xd8 puts the two halves back in order */
+AVX2_TARGET static void __deinterleave_avx2(const uint8_t *src, uint8_t *u, uint8_t *v, int n) {
+    const __m256i mask = _mm256_set1_epi16(0x00ff);
+    int i = 0;
+    
+    for (; i + 32 <= n; i += 32) {
+        __m256i a = _mm256_loadu_si256((const __m256i *)(src + 2 * i));
+        __m256i b = _mm256_loadu_si256((const __m256i *)(src + 2 * i + 32));
+        __m256i uu = _mm256_packus_epi16(_mm256_and_si256(a, mask), _mm256_and_si256(b, mask));
+        __m256i vv = _mm256_packus_epi16(_mm256_srli_epi16(a, 8), _mm256_srli_epi16(b, 8));
+        _mm256_storeu_si256((__m256i *)(u + i), _mm256_permute4x64_epi64(uu, 0xd8));
+        _mm256_storeu_si256((__m256i *)(v + i), _mm256_permute4x64_epi64(vv, 0xd8));
+    }
+    __deinterleave_sse2(src + 2 * i, u + i, v + i, n - i);
+}
+
+AVX2_TARGET static void __pack_avx2(const uint16_t *src, uint8_t *dst, int n, int shift) {
+    const __m128i count = _mm_cvtsi32_si128(shift);
+    int i = 0;
+    
+    for (; i + 32 <= n; i += 32) {
+        __m256i a = _mm256_srl_epi16(_mm256_loadu_si256((const __m256i *)(src + i)), count);
+        __m256i b = _mm256_srl_epi16(_mm256_loadu_si256((const __m256i *)(src + i + 16)), count);
+        _mm256_storeu_si256((__m256i *)(dst + i),
+                            _mm256_permute4x64_epi64(_mm256_packus_epi16(a, b), 0xd8));
+    }
+    __pack_sse2(src + i, dst + i, n - i, shift);
+}
+
+AVX2_TARGET static void __deinterleave16_avx2(const uint16_t *src, uint8_t *u, uint8_t *v, int n, int shift) {
+    const __m128i count = _mm_cvtsi32_si128(shift);
+    const __m256i mask = _mm256_set1_epi32(0xffff);
+    int i = 0;
+    
+    for (; i + 16 <= n; i += 16) {
+        __m256i a = _mm256_srl_epi16(_mm256_loadu_si256((const __m256i *)(src + 2 * i)), count);
+        __m256i b = _mm256_srl_epi16(_mm256_loadu_si256((const __m256i *)(src + 2 * i + 16)), count);
+        __m256i uw = _mm256_permute4x64_epi64(_mm256_packs_epi32(_mm256_and_si256(a, mask),
+                                                                 _mm256_and_si256(b, mask)), 0xd8);
+        __m256i vw = _mm256_permute4x64_epi64(_mm256_packs_epi32(_mm256_srli_epi32(a, 16),
+                                                                 _mm256_srli_epi32(b, 16)), 0xd8);
+        _mm_storeu_si128((__m128i *)(u + i), _mm_packus_epi16(_mm256_castsi256_si128(uw),
+                                                              _mm256_extracti128_si256(uw, 1)));
+        _mm_storeu_si128((__m128i *)(v + i), _mm_packus_epi16(_mm256_castsi256_si128(vw),
+                                                              _mm256_extracti128_si256(vw, 1)));
+    }
+    __deinterleave16_sse2(src + 2 * i, u + i, v + i, n - i, shift);
+}
+
+#endif
+
+void yuvUpload_init(void) {
+    int flags = av_get_cpu_flags();
+    
+    deinterleave_row = __deinterleave_c;
+    pack_row = __pack_c;
+    deinterleave16_row = __deinterleave16_c;
+    kernel_isa = "c";
+#if YUV_UPLOAD_X86
+    if (flags & AV_CPU_FLAG_SSE2) {
+        deinterleave_row = __deinterleave_sse2;
+        pack_row = __pack_sse2;
+        deinterleave16_row = __deinterleave16_sse2;
+        kernel_isa = "sse2";
+    }
+    if (flags & AV_CPU_FLAG_AVX2) {
+        deinterleave_row = __deinterleave_avx2;
+        pack_row = __pack_avx2;
+        deinterleave16_row = __deinterleave16_avx2;
+        kernel_isa = "avx2";
+    }
+#else
+    (void)flags;
+#endif
+}
+
+const char *yuvUpload_isa(void) {
+    return kernel_isa;
+}
+
+int yuvUpload_supported(enum AVPixelFormat format) {
+    switch (format) {
+        case AV_PIX_FMT_YUV420P:
+        case AV_PIX_FMT_YUVJ420P:
+        case AV_PIX_FMT_NV12:
+        case AV_PIX_FMT_NV21:
+        case AV_PIX_FMT_YUV420P10LE:
+        case AV_PIX_FMT_P010LE:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+static void __copy_plane(uint8_t *dst, int dst_pitch,
+                         const uint8_t *src, int src_pitch,
+                         int width, int height) {
+    if (dst_pitch == src_pitch && src_pitch == width) {
+        memcpy(dst, src, (size_t)width * height);
+        return;
+    }
+    for (int y = 0; y < height; y++) {
+        memcpy(dst + (size_t)y * dst_pitch, src + (size_t)y * src_pitch, width);
+    }
+}
+
+static void __pack_plane(uint8_t *dst, int dst_pitch,
+                         const uint8_t *src, int src_pitch,
+                         int width, int height, int shift) {
+    for (int y = 0; y < height; y++) {
+        pack_row((const uint16_t *)(src + (size_t)y * src_pitch), dst + (size_t)y * dst_pitch, width, shift);
+    }
+}
+
+/*
+ * IYUV texture memory as SDL hands it out: Y with pitch, then U and V
+ * with (pitch + 1) / 2, each (height + 1) / 2 rows
+ */
+int yuvUpload_frame(const AVFrame *frame, uint8_t *pixels, int pitch) {
+    int w = frame->width, h = frame->height;
+    int cw = (w + 1) / 2, ch = (h + 1) / 2;
+    int cpitch = (pitch + 1) / 2;
+    uint8_t *dst_y = pixels;
+    uint8_t *dst_u = dst_y + (size_t)pitch * h;
+    uint8_t *dst_v = dst_u + (size_t)cpitch * ch;
+    
+    if (!deinterleave_row)
+        yuvUpload_init();
+    
+    switch (frame->format) {
+        case AV_PIX_FMT_YUV420P:
+        case AV_PIX_FMT_YUVJ420P:
+            __copy_plane(dst_y, pitch, frame->data[0], frame->linesize[0], w, h);
+            __copy_plane(dst_u, cpitch, frame->data[1], frame->linesize[1], cw, ch);
+            __copy_plane(dst_v, cpitch, frame->data[2], frame->linesize[2], cw, ch);
+            break;
+        case AV_PIX_FMT_NV12:
+        case AV_PIX_FMT_NV21:
+            __copy_plane(dst_y, pitch, frame->data[0], frame->linesize[0], w, h);
+            for (int y = 0; y < ch; y++) {
+                const uint8_t *src = frame->data[1] + (size_t)y * frame->linesize[1];
+                uint8_t *u = dst_u + (size_t)y * cpitch;
+                uint8_t *v = dst_v + (size_t)y * cpitch;
+                if (frame->format == AV_PIX_FMT_NV12)
+                    deinterleave_row(src, u, v, cw);
+                else
+                    deinterleave_row(src, v, u, cw);
+            }
+            break;
+        case AV_PIX_FMT_YUV420P10LE:
+            __pack_plane(dst_y, pitch, frame->data[0], frame->linesize[0], w, h, 2);
+            __pack_plane(dst_u, cpitch, frame->data[1], frame->linesize[1], cw, ch, 2);
+            __pack_plane(dst_v, cpitch, frame->data[2], frame->linesize[2], cw, ch, 2);
+            break;
+        case AV_PIX_FMT_P010LE:
+            /* 10 bit samples sit in the high bits */
+            __pack_plane(dst_y, pitch, frame->data[0], frame->linesize[0], w, h, 8);
+            for (int y = 0; y < ch; y++) {
+                deinterleave16_row((const uint16_t *)(frame->data[1] + (size_t)y * frame->linesize[1]),
+                                   dst_u + (size_t)y * cpitch,
+                                   dst_v + (size_t)y * cpitch,
+                                   cw, 8);
+            }
+            break;
+        default:
+            return AVERROR(EINVAL);
+    }
+    return 0;
+}
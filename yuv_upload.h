@@ -0,0 +1,26 @@
+//
+//  yuv_upload.h
+//  ffmpeg_proj
+//
+//  Created by HorsonChan on 2026/10/17.
+//
+
+#ifndef yuv_upload_h
+#define yuv_upload_h
+
+#include <stdio.h>
+#include <stdint.h>
+#include <libavutil/frame.h>
+#include <libavutil/avutil.h>
+
+/*
+ * writes a decoded frame straight into a locked IYUV streaming texture.
+ * 8 bit planes are row copies, semi planar chroma and 10 bit samples are
+ * packed on the fly by SSE2/AVX2 row kernels picked at runtime, so those
+ * formats skip sws and its intermediate frame altogether.
+ */
+void yuvUpload_init(void);
+int yuvUpload_supported(enum AVPixelFormat format);
+int yuvUpload_frame(const AVFrame *frame, uint8_t *pixels, int pitch);
+const char *yuvUpload_isa(void);
+#endif /* yuv_upload_h */